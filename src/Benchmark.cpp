@@ -0,0 +1,223 @@
+#include "Benchmark.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace gps {
+
+    namespace {
+
+        const char* const METRICS[] = { "cpu_ms", "gpu_ms", "draw_calls", "triangles", "state_calls", "elided_state_calls" };
+        const int METRIC_COUNT = 6;
+
+        double metricValue(const FrameSample& sample, const std::string& metric)
+        {
+            if (metric == "cpu_ms")
+                return sample.cpuMs;
+            if (metric == "gpu_ms")
+                return sample.gpuMs;
+            if (metric == "draw_calls")
+                return (double)sample.drawCalls;
+            if (metric == "state_calls")
+                return (double)sample.stateCalls;
+            if (metric == "elided_state_calls")
+                return (double)sample.elidedStateCalls;
+            return (double)sample.triangles;
+        }
+
+        // Value of "stat" inside the "metric" object of a report, the reports are only ever written by WriteReport
+        bool readSummaryValue(const std::string& json, const std::string& metric, const std::string& stat, double& value)
+        {
+            size_t metricStart = json.find("\"" + metric + "\"");
+            if (metricStart == std::string::npos)
+                return false;
+            size_t metricEnd = json.find('}', metricStart);
+            size_t statStart = json.find("\"" + stat + "\"", metricStart);
+            if (statStart == std::string::npos || statStart > metricEnd)
+                return false;
+            size_t colon = json.find(':', statStart);
+            return colon != std::string::npos && sscanf(json.c_str() + colon + 1, "%lf", &value) == 1;
+        }
+    }
+
+    Benchmark::Benchmark()
+    {
+        for (int i = 0; i < QUERY_LATENCY; i++) {
+            queries[i][0] = 0;
+            queries[i][1] = 0;
+            queryFrame[i] = 0;
+            queryPending[i] = false;
+        }
+    }
+
+    Benchmark::~Benchmark()
+    {
+        if (queries[0][0] != 0)
+            glDeleteQueries(QUERY_LATENCY * 2, &queries[0][0]);
+    }
+
+    // Creates the queries, needs the context
+    void Benchmark::Init()
+    {
+        glGenQueries(QUERY_LATENCY * 2, &queries[0][0]);
+    }
+
+    void Benchmark::BeginFrame()
+    {
+        //the slot is reused every QUERY_LATENCY frames, by then its results are normally there
+        int slot = (int)(frames.size() % QUERY_LATENCY);
+        if (queryPending[slot])
+            ResolveQueries(slot);
+
+        frameStart = std::chrono::steady_clock::now();
+        glQueryCounter(queries[slot][0], GL_TIMESTAMP);
+    }
+
+    // Ends the CPU time of the frame, call before presenting
+    void Benchmark::EndFrame(size_t drawCalls, size_t triangles, size_t stateCalls, size_t elidedStateCalls)
+    {
+        int slot = (int)(frames.size() % QUERY_LATENCY);
+        glQueryCounter(queries[slot][1], GL_TIMESTAMP);
+        queryFrame[slot] = frames.size();
+        queryPending[slot] = true;
+
+        FrameSample sample;
+        sample.cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+        sample.gpuMs = 0.0;
+        sample.drawCalls = drawCalls;
+        sample.triangles = triangles;
+        sample.stateCalls = stateCalls;
+        sample.elidedStateCalls = elidedStateCalls;
+        frames.push_back(sample);
+    }
+
+    // Waits for the GPU times still in flight
+    void Benchmark::Finish()
+    {
+        for (int i = 0; i < QUERY_LATENCY; i++) {
+            if (queryPending[i])
+                ResolveQueries(i);
+        }
+    }
+
+    // Reads the GPU time of the frame in the slot into its sample
+    void Benchmark::ResolveQueries(int slot)
+    {
+        GLuint64 start = 0;
+        GLuint64 end = 0;
+        glGetQueryObjectui64v(queries[slot][0], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(queries[slot][1], GL_QUERY_RESULT, &end);
+        frames[queryFrame[slot]].gpuMs = (double)(end - start) / 1.0e6;
+        queryPending[slot] = false;
+    }
+
+    size_t Benchmark::GetFrameCount() const
+    {
+        return frames.size();
+    }
+
+    MetricSummary Benchmark::Summarize(const std::string& metric) const
+    {
+        std::vector<double> values(frames.size());
+        for (size_t i = 0; i < frames.size(); i++)
+            values[i] = metricValue(frames[i], metric);
+        return Summarize(values);
+    }
+
+    // Nearest-rank percentiles
+    MetricSummary Benchmark::Summarize(std::vector<double> values)
+    {
+        MetricSummary summary = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+        if (values.empty())
+            return summary;
+
+        std::sort(values.begin(), values.end());
+        double total = 0.0;
+        for (size_t i = 0; i < values.size(); i++)
+            total += values[i];
+
+        size_t count = values.size();
+        auto percentile = [&](double p) {
+            size_t rank = (size_t)std::ceil(p / 100.0 * count);
+            return values[std::min(std::max(rank, (size_t)1), count) - 1];
+        };
+        summary.mean = total / count;
+        summary.p50 = percentile(50.0);
+        summary.p95 = percentile(95.0);
+        summary.p99 = percentile(99.0);
+        summary.worst = values.back();
+        return summary;
+    }
+
+    // Writes <path>.json and <path>.csv
+    bool Benchmark::WriteReport(const std::string& path) const
+    {
+        std::ofstream json((path + ".json").c_str());
+        if (!json) {
+            fprintf(stderr, "ERROR: could not write %s.json\n", path.c_str());
+            return false;
+        }
+        json << "{\n    \"frames\": " << frames.size();
+        for (int i = 0; i < METRIC_COUNT; i++) {
+            MetricSummary summary = Summarize(METRICS[i]);
+            json << ",\n    \"" << METRICS[i] << "\": { "
+                 << "\"mean\": " << summary.mean << ", "
+                 << "\"p50\": " << summary.p50 << ", "
+                 << "\"p95\": " << summary.p95 << ", "
+                 << "\"p99\": " << summary.p99 << ", "
+                 << "\"worst\": " << summary.worst << " }";
+        }
+        json << "\n}\n";
+
+        std::ofstream csv((path + ".csv").c_str());
+        if (!csv) {
+            fprintf(stderr, "ERROR: could not write %s.csv\n", path.c_str());
+            return false;
+        }
+        csv << "frame,cpu_ms,gpu_ms,draw_calls,triangles,state_calls,elided_state_calls\n";
+        for (size_t i = 0; i < frames.size(); i++) {
+            const FrameSample& sample = frames[i];
+            csv << i << ',' << sample.cpuMs << ',' << sample.gpuMs << ',' << sample.drawCalls << ',' << sample.triangles
+                << ',' << sample.stateCalls << ',' << sample.elidedStateCalls << '\n';
+        }
+        return json.good() && csv.good();
+    }
+
+    // Compares cpu_ms and gpu_ms (mean and p95) against a report written before
+    bool Benchmark::CompareWithBaseline(const std::string& baselinePath, double thresholdPercent) const
+    {
+        std::ifstream file(baselinePath.c_str());
+        if (!file) {
+            fprintf(stderr, "ERROR: could not read the baseline %s\n", baselinePath.c_str());
+            return false;
+        }
+        std::stringstream contents;
+        contents << file.rdbuf();
+        std::string json = contents.str();
+
+        const char* const timings[] = { "cpu_ms", "gpu_ms" };
+        const char* const stats[] = { "mean", "p95" };
+        bool passed = true;
+        for (int i = 0; i < 2; i++) {
+            MetricSummary summary = Summarize(timings[i]);
+            for (int j = 0; j < 2; j++) {
+                double baseline;
+                if (!readSummaryValue(json, timings[i], stats[j], baseline)) {
+                    fprintf(stderr, "ERROR: the baseline has no %s %s\n", timings[i], stats[j]);
+                    return false;
+                }
+                double current = strcmp(stats[j], "mean") == 0 ? summary.mean : summary.p95;
+                double change = baseline > 0.0 ? (current - baseline) / baseline * 100.0 : 0.0;
+                bool regressed = change > thresholdPercent;
+                printf("%-7s %-5s baseline %9.3f current %9.3f %+7.2f%%%s\n",
+                       timings[i], stats[j], baseline, current, change, regressed ? "  REGRESSION" : "");
+                passed = passed && !regressed;
+            }
+        }
+        return passed;
+    }
+}
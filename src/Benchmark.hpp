@@ -0,0 +1,92 @@
+#ifndef Benchmark_hpp
+#define Benchmark_hpp
+
+#include "GLHandle.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Measurements of one frame
+    struct FrameSample
+    {
+        // wall time of the simulation and the submission, without presenting
+        double cpuMs;
+        // time the GPU spent between the start and the end of the frame
+        double gpuMs;
+        size_t drawCalls;
+        size_t triangles;
+        // state changes the GLStateCache made and dropped
+        size_t stateCalls;
+        size_t elidedStateCalls;
+    };
+
+    // Distribution of one measurement over the recorded frames
+    struct MetricSummary
+    {
+        double mean;
+        double p50;
+        double p95;
+        double p99;
+        double worst;
+    };
+
+    // Records a FrameSample per frame and writes them out as a report: a JSON summary (mean, p50,
+    // p95, p99 and worst of every measurement) and a CSV with one row per frame. The GPU time comes
+    // from timestamp queries read a few frames late, so measuring never waits for the GPU.
+    class Benchmark
+    {
+    public:
+        Benchmark();
+        ~Benchmark();
+
+        // Creates the queries, needs the context
+        void Init();
+
+        void BeginFrame();
+
+        // Ends the CPU time of the frame, call before presenting
+        void EndFrame(size_t drawCalls, size_t triangles, size_t stateCalls, size_t elidedStateCalls);
+
+        // Waits for the GPU times still in flight
+        void Finish();
+
+        size_t GetFrameCount() const;
+
+        // Summaries of the recorded frames, by the names used in the report
+        // (cpu_ms, gpu_ms, draw_calls, triangles, state_calls, elided_state_calls)
+        MetricSummary Summarize(const std::string& metric) const;
+
+        // Writes <path>.json and <path>.csv, false if either cannot be written
+        bool WriteReport(const std::string& path) const;
+
+        // Compares cpu_ms and gpu_ms (mean and p95) against a report written before. Differences are
+        // printed, false when one of them grew by more than thresholdPercent or the baseline is unreadable.
+        bool CompareWithBaseline(const std::string& baselinePath, double thresholdPercent) const;
+
+    private:
+        // frames the GPU times are read behind
+        static const int QUERY_LATENCY = 4;
+
+        std::vector<FrameSample> frames;
+        std::chrono::steady_clock::time_point frameStart;
+
+        // start and end timestamp of the frames in flight, and the frame each pair belongs to
+        GLuint queries[QUERY_LATENCY][2];
+        size_t queryFrame[QUERY_LATENCY];
+        bool queryPending[QUERY_LATENCY];
+
+        // Reads the GPU time of the frame in the slot into its sample
+        void ResolveQueries(int slot);
+
+        static MetricSummary Summarize(std::vector<double> values);
+
+        Benchmark(const Benchmark&);
+        Benchmark& operator=(const Benchmark&);
+    };
+}
+
+#endif /* Benchmark_hpp */
@@ -63,19 +63,21 @@ namespace gps {
         this->cameraRightDirection = glm::normalize(glm::cross(this->cameraUpDirection, this->cameraFrontDirection));
     }
 
-    void Camera::preview(bool flag, FILE* pf) {
+    bool Camera::preview(bool flag, FILE* pf) {
         if (flag) {
             glm::vec3 tmp;
             if (fscanf(pf, "%f %f %f\n", &tmp.x, &tmp.y, &tmp.z) == 3) {
                 this->cameraPosition = tmp;
                 if (fscanf(pf, "%f %f %f\n", &tmp.x, &tmp.y, &tmp.z) == 3) {
                     this->cameraTarget = tmp;
+                    return true;
                 }
             }
+            return false;
         }
         else {
             fseek(pf, 0, SEEK_SET);
         }
-
+        return true;
     }
 }
\ No newline at end of file
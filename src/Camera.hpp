@@ -24,7 +24,8 @@ namespace gps {
         //yaw - camera rotation around the y axis
         //pitch - camera rotation around the x axis
         void rotate(float pitch, float yaw);
-        void preview(bool flag, FILE* pf);
+        //move along the path recorded in pf, one position/target pair per call, returns false at its end
+        bool preview(bool flag, FILE* pf);
         glm::vec3 cameraTarget;
         glm::vec3 cameraFrontDirection;
         glm::vec3 cameraRightDirection;
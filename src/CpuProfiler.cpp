@@ -0,0 +1,161 @@
+#include "CpuProfiler.hpp"
+
+#ifdef GPS_PROFILE
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+namespace gps {
+
+    namespace {
+
+        const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+        // Zone names are identifiers and string literals, only quotes and backslashes need escaping
+        void writeEscaped(std::ofstream& out, const char* text)
+        {
+            for (; *text != '\0'; text++) {
+                if (*text == '"' || *text == '\\')
+                    out << '\\';
+                out << *text;
+            }
+        }
+    }
+
+    // The profiler is never destroyed, threads may still record while the process exits
+    CpuProfiler& CpuProfiler::Get()
+    {
+        static CpuProfiler* profiler = new CpuProfiler();
+        return *profiler;
+    }
+
+    CpuProfiler::CpuProfiler()
+    {
+    }
+
+    CpuProfiler::~CpuProfiler()
+    {
+    }
+
+    // Nanoseconds since the profiler started
+    uint64_t CpuProfiler::Now()
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+    }
+
+    // Records a finished zone of the calling thread
+    void CpuProfiler::Record(const char* name, uint64_t start, uint64_t end)
+    {
+        ThreadBuffer& buffer = GetThreadBuffer();
+        Chunk* chunk = buffer.tail;
+        size_t count = chunk->count.load(std::memory_order_relaxed);
+        if (count == CHUNK_EVENTS) {
+            std::lock_guard<std::mutex> lock(buffer.chunksMutex);
+            Chunk* next;
+            if (buffer.chunkCount < MAX_CHUNKS) {
+                next = new Chunk();
+                buffer.chunkCount++;
+            } else {
+                //drop the oldest zones, WriteTrace cannot be reading the chunk while we hold the lock
+                next = buffer.head;
+                buffer.head = next->next;
+                next->next = nullptr;
+                next->count.store(0, std::memory_order_relaxed);
+            }
+            chunk->next = next;
+            buffer.tail = next;
+            chunk = next;
+            count = 0;
+        }
+
+        Event& event = chunk->events[count];
+        event.name = name;
+        event.start = start;
+        event.end = end;
+        //publishes the event to WriteTrace
+        chunk->count.store(count + 1, std::memory_order_release);
+    }
+
+    void CpuProfiler::SetThreadName(const char* name)
+    {
+        ThreadBuffer& buffer = GetThreadBuffer();
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        buffer.name = name;
+    }
+
+    // Buffer of the calling thread, created on its first zone
+    CpuProfiler::ThreadBuffer& CpuProfiler::GetThreadBuffer()
+    {
+        thread_local ThreadBuffer* buffer = nullptr;
+        if (buffer == nullptr) {
+            buffer = new ThreadBuffer();
+            buffer->head = new Chunk();
+            buffer->tail = buffer->head;
+            buffer->chunkCount = 1;
+
+            std::lock_guard<std::mutex> lock(threadsMutex);
+            buffer->id = (int)threads.size();
+            threads.push_back(buffer);
+        }
+        return *buffer;
+    }
+
+    // Writes the zones recorded so far as complete ("X") events, times in microseconds
+    bool CpuProfiler::WriteTrace(const std::string& path)
+    {
+        std::ofstream out(path.c_str());
+        if (!out) {
+            fprintf(stderr, "ERROR: could not write the trace %s\n", path.c_str());
+            return false;
+        }
+
+        std::vector<ThreadBuffer*> buffers;
+        std::vector<std::string> names;
+        {
+            std::lock_guard<std::mutex> lock(threadsMutex);
+            buffers = threads;
+            for (size_t i = 0; i < threads.size(); i++)
+                names.push_back(threads[i]->name);
+        }
+
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool first = true;
+        char number[64];
+        std::vector<Event> events;
+        for (size_t i = 0; i < buffers.size(); i++) {
+            if (!names[i].empty()) {
+                out << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffers[i]->id
+                    << ",\"args\":{\"name\":\"";
+                writeEscaped(out, names[i].c_str());
+                out << "\"}}";
+                first = false;
+            }
+
+            //copy the zones out, the thread waits on the lock only if it fills a chunk meanwhile
+            events.clear();
+            {
+                std::lock_guard<std::mutex> lock(buffers[i]->chunksMutex);
+                for (Chunk* chunk = buffers[i]->head; chunk != nullptr; chunk = chunk->next) {
+                    size_t count = chunk->count.load(std::memory_order_acquire);
+                    events.insert(events.end(), chunk->events, chunk->events + count);
+                }
+            }
+
+            for (size_t j = 0; j < events.size(); j++) {
+                const Event& event = events[j];
+                out << (first ? "\n" : ",\n") << "{\"name\":\"";
+                writeEscaped(out, event.name);
+                snprintf(number, sizeof(number), "%.3f,\"dur\":%.3f", event.start / 1000.0, (event.end - event.start) / 1000.0);
+                out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffers[i]->id << ",\"ts\":" << number << "}";
+                first = false;
+            }
+        }
+        out << "\n]}\n";
+
+        printf("wrote the CPU trace to %s\n", path.c_str());
+        return out.good();
+    }
+}
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef CpuProfiler_hpp
+#define CpuProfiler_hpp
+
+// Zones of CPU time, written as a chrome://tracing / Perfetto JSON trace. Everything here is only
+// compiled with GPS_PROFILE defined, without it the macros expand to nothing and can stay in the
+// hot loops for good. The Profile|x64 configuration of the project is Release with GPS_PROFILE.
+//
+//   GPS_PROFILE_SCOPE("name")      times the enclosing block
+//   GPS_PROFILE_FUNCTION()         times the enclosing function, named after it
+//   GPS_PROFILE_THREAD("name")     names the calling thread in the trace
+//   GPS_PROFILE_WRITE("file.json") writes every zone recorded so far
+
+#ifdef GPS_PROFILE
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Zones recorded by the threads, each thread appends to its own buffer without locking. A buffer
+    // is a ring of at most MAX_CHUNKS fixed size chunks, once it is full the oldest chunk is reused,
+    // so a long session keeps only its most recent zones. The trace can be written while the threads
+    // keep recording: a zone only becomes visible once the count of its chunk includes it, and the
+    // chunk list of a thread only changes under its mutex.
+    class CpuProfiler
+    {
+    public:
+        // The profiler of the process, there is only one
+        static CpuProfiler& Get();
+
+        // Nanoseconds since the profiler started
+        static uint64_t Now();
+
+        // Records a finished zone of the calling thread, name has to outlive the profiler
+        void Record(const char* name, uint64_t start, uint64_t end);
+
+        void SetThreadName(const char* name);
+
+        // Writes the zones recorded so far, false if the file cannot be written
+        bool WriteTrace(const std::string& path);
+
+    private:
+        static const size_t CHUNK_EVENTS = 4096;
+        // 24 bytes per zone, about 6 MB per thread
+        static const size_t MAX_CHUNKS = 64;
+
+        struct Event
+        {
+            const char* name;
+            uint64_t start;
+            uint64_t end;
+        };
+
+        struct Chunk
+        {
+            Event events[CHUNK_EVENTS];
+            std::atomic<size_t> count;
+            Chunk* next;
+
+            Chunk() : count(0), next(nullptr) {}
+        };
+
+        struct ThreadBuffer
+        {
+            int id;
+            std::string name;
+            // the chunk list, guarded by the mutex, which is only locked when a chunk fills up
+            std::mutex chunksMutex;
+            Chunk* head;
+            Chunk* tail;
+            size_t chunkCount;
+        };
+
+        // every thread that recorded something, guarded by the mutex, locked once per thread
+        std::vector<ThreadBuffer*> threads;
+        std::mutex threadsMutex;
+
+        CpuProfiler();
+        ~CpuProfiler();
+
+        // Buffer of the calling thread, created on its first zone
+        ThreadBuffer& GetThreadBuffer();
+
+        CpuProfiler(const CpuProfiler&);
+        CpuProfiler& operator=(const CpuProfiler&);
+    };
+
+    // Records a zone from its construction to the end of the enclosing block
+    class CpuZone
+    {
+    public:
+        explicit CpuZone(const char* name) : name(name), start(CpuProfiler::Now())
+        {
+        }
+
+        ~CpuZone()
+        {
+            CpuProfiler::Get().Record(name, start, CpuProfiler::Now());
+        }
+
+    private:
+        const char* name;
+        uint64_t start;
+
+        CpuZone(const CpuZone&);
+        CpuZone& operator=(const CpuZone&);
+    };
+}
+
+#define GPS_PROFILE_CONCAT_(a, b) a##b
+#define GPS_PROFILE_CONCAT(a, b) GPS_PROFILE_CONCAT_(a, b)
+#define GPS_PROFILE_SCOPE(name) gps::CpuZone GPS_PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define GPS_PROFILE_FUNCTION() GPS_PROFILE_SCOPE(__func__)
+#define GPS_PROFILE_THREAD(name) gps::CpuProfiler::Get().SetThreadName(name)
+#define GPS_PROFILE_WRITE(path) gps::CpuProfiler::Get().WriteTrace(path)
+
+#else
+
+#define GPS_PROFILE_SCOPE(name)
+#define GPS_PROFILE_FUNCTION()
+#define GPS_PROFILE_THREAD(name)
+#define GPS_PROFILE_WRITE(path)
+
+#endif
+
+#endif /* CpuProfiler_hpp */
@@ -0,0 +1,176 @@
+#include "Frustum.hpp"
+
+#include <cfloat>
+#include <cmath>
+
+namespace gps {
+
+    AABB emptyBounds()
+    {
+        AABB bounds;
+        bounds.min = glm::vec3(FLT_MAX);
+        bounds.max = glm::vec3(-FLT_MAX);
+        return bounds;
+    }
+
+    AABB mergeBounds(const AABB& a, const AABB& b)
+    {
+        AABB bounds;
+        bounds.min = glm::min(a.min, b.min);
+        bounds.max = glm::max(a.max, b.max);
+        return bounds;
+    }
+
+    AABB transformBounds(const AABB& bounds, const glm::mat4& transform)
+    {
+        if (bounds.min.x > bounds.max.x)
+            return bounds;
+
+        glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+        glm::vec3 extent = (bounds.max - bounds.min) * 0.5f;
+
+        glm::vec3 newCenter = glm::vec3(transform * glm::vec4(center, 1.0f));
+        glm::vec3 newExtent;
+        for (int i = 0; i < 3; i++) {
+            newExtent[i] = std::fabs(transform[0][i]) * extent.x +
+                           std::fabs(transform[1][i]) * extent.y +
+                           std::fabs(transform[2][i]) * extent.z;
+        }
+
+        AABB result;
+        result.min = newCenter - newExtent;
+        result.max = newCenter + newExtent;
+        return result;
+    }
+
+    BoundingSphere transformSphere(const BoundingSphere& sphere, const glm::mat4& transform)
+    {
+        float scale = 0.0f;
+        for (int i = 0; i < 3; i++) {
+            glm::vec3 axis = glm::vec3(transform[i]);
+            scale = std::fmax(scale, glm::dot(axis, axis));
+        }
+
+        BoundingSphere result;
+        result.center = glm::vec3(transform * glm::vec4(sphere.center, 1.0f));
+        result.radius = sphere.radius * std::sqrt(scale);
+        return result;
+    }
+
+    Frustum::Frustum() : enabled(false)
+    {
+    }
+
+    Frustum::Frustum(const glm::mat4& viewProjection) : enabled(true)
+    {
+        // Gribb/Hartmann: every plane is the last row of the matrix plus or minus another row
+        glm::vec4 row[4];
+        for (int i = 0; i < 4; i++)
+            row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+        glm::vec4 planes[PLANE_SLOTS] = {
+            row[3] + row[0], // left
+            row[3] - row[0], // right
+            row[3] + row[1], // bottom
+            row[3] - row[1], // top
+            row[3] + row[2], // near
+            row[3] - row[2], // far
+        };
+        for (int i = 0; i < 6; i++) {
+            float length = glm::length(glm::vec3(planes[i]));
+            if (length > 0.0f)
+                planes[i] = planes[i] / length;
+        }
+        planes[6] = planes[5];
+        planes[7] = planes[5];
+
+#ifdef GPS_FRUSTUM_SSE
+        for (int group = 0; group < 2; group++) {
+            const glm::vec4* p = planes + group * 4;
+            x[group] = _mm_setr_ps(p[0].x, p[1].x, p[2].x, p[3].x);
+            y[group] = _mm_setr_ps(p[0].y, p[1].y, p[2].y, p[3].y);
+            z[group] = _mm_setr_ps(p[0].z, p[1].z, p[2].z, p[3].z);
+            w[group] = _mm_setr_ps(p[0].w, p[1].w, p[2].w, p[3].w);
+
+            // clearing the sign bit gives the absolute values used by the box test
+            __m128 signMask = _mm_set1_ps(-0.0f);
+            absX[group] = _mm_andnot_ps(signMask, x[group]);
+            absY[group] = _mm_andnot_ps(signMask, y[group]);
+            absZ[group] = _mm_andnot_ps(signMask, z[group]);
+        }
+#else
+        for (int i = 0; i < PLANE_SLOTS; i++) {
+            x[i] = planes[i].x;
+            y[i] = planes[i].y;
+            z[i] = planes[i].z;
+            w[i] = planes[i].w;
+        }
+#endif
+    }
+
+    // Outside as soon as the center is further than the radius behind one plane
+    bool Frustum::Intersects(const BoundingSphere& sphere) const
+    {
+        if (!enabled)
+            return true;
+
+#ifdef GPS_FRUSTUM_SSE
+        __m128 cx = _mm_set1_ps(sphere.center.x);
+        __m128 cy = _mm_set1_ps(sphere.center.y);
+        __m128 cz = _mm_set1_ps(sphere.center.z);
+        __m128 radius = _mm_set1_ps(-sphere.radius);
+        int outside = 0;
+        for (int group = 0; group < 2; group++) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x[group], cx), _mm_mul_ps(y[group], cy)),
+                                         _mm_add_ps(_mm_mul_ps(z[group], cz), w[group]));
+            outside |= _mm_movemask_ps(_mm_cmplt_ps(distance, radius));
+        }
+        return outside == 0;
+#else
+        for (int i = 0; i < PLANE_SLOTS; i++) {
+            float distance = x[i] * sphere.center.x + y[i] * sphere.center.y + z[i] * sphere.center.z + w[i];
+            if (distance < -sphere.radius)
+                return false;
+        }
+        return true;
+#endif
+    }
+
+    // Outside when even the corner furthest along a plane normal is behind that plane
+    bool Frustum::Intersects(const AABB& bounds) const
+    {
+        if (!enabled)
+            return true;
+        if (bounds.min.x > bounds.max.x)
+            return false;
+
+        glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+        glm::vec3 extent = (bounds.max - bounds.min) * 0.5f;
+
+#ifdef GPS_FRUSTUM_SSE
+        __m128 cx = _mm_set1_ps(center.x);
+        __m128 cy = _mm_set1_ps(center.y);
+        __m128 cz = _mm_set1_ps(center.z);
+        __m128 ex = _mm_set1_ps(extent.x);
+        __m128 ey = _mm_set1_ps(extent.y);
+        __m128 ez = _mm_set1_ps(extent.z);
+        int outside = 0;
+        for (int group = 0; group < 2; group++) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x[group], cx), _mm_mul_ps(y[group], cy)),
+                                         _mm_add_ps(_mm_mul_ps(z[group], cz), w[group]));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absX[group], ex), _mm_mul_ps(absY[group], ey)),
+                                       _mm_mul_ps(absZ[group], ez));
+            outside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+        }
+        return outside == 0;
+#else
+        for (int i = 0; i < PLANE_SLOTS; i++) {
+            float distance = x[i] * center.x + y[i] * center.y + z[i] * center.z + w[i];
+            float radius = std::fabs(x[i]) * extent.x + std::fabs(y[i]) * extent.y + std::fabs(z[i]) * extent.z;
+            if (distance + radius < 0.0f)
+                return false;
+        }
+        return true;
+#endif
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef Frustum_hpp
+#define Frustum_hpp
+
+#include "glm/glm.hpp"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define GPS_FRUSTUM_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace gps {
+
+    // Axis aligned bounding box
+    struct AABB
+    {
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+
+    struct BoundingSphere
+    {
+        glm::vec3 center;
+        float radius;
+    };
+
+    // Box that contains nothing, merging anything into it gives that thing back
+    AABB emptyBounds();
+    AABB mergeBounds(const AABB& a, const AABB& b);
+    // Bounds of the transformed box (not the tightest box around the transformed geometry)
+    AABB transformBounds(const AABB& bounds, const glm::mat4& transform);
+    BoundingSphere transformSphere(const BoundingSphere& sphere, const glm::mat4& transform);
+
+    // The six clip planes of a view-projection matrix, tested four at a time with SSE
+    class Frustum
+    {
+    public:
+        // A frustum that accepts everything
+        Frustum();
+        explicit Frustum(const glm::mat4& viewProjection);
+
+        bool Intersects(const BoundingSphere& sphere) const;
+        bool Intersects(const AABB& bounds) const;
+
+    private:
+        // Plane i is (x[i], y[i], z[i], w[i]), inside when dot(plane, point) + w >= 0.
+        // The 6 planes are padded to 8 by repeating the last one.
+        static const int PLANE_SLOTS = 8;
+#ifdef GPS_FRUSTUM_SSE
+        __m128 x[2], y[2], z[2], w[2];
+        __m128 absX[2], absY[2], absZ[2];
+#else
+        float x[PLANE_SLOTS], y[PLANE_SLOTS], z[PLANE_SLOTS], w[PLANE_SLOTS];
+#endif
+        bool enabled;
+    };
+}
+
+#endif /* Frustum_hpp */
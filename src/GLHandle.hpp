@@ -0,0 +1,99 @@
+#ifndef GLHandle_hpp
+#define GLHandle_hpp
+
+#include <GL/glew.h>
+
+namespace gps {
+
+    // Move-only owner of a GL object name, the object is deleted with the handle
+    template <class Traits>
+    class GLHandle
+    {
+    public:
+        GLHandle() : id(0) {}
+
+        explicit GLHandle(GLuint id) : id(id) {}
+
+        GLHandle(GLHandle&& other) : id(other.release()) {}
+
+        GLHandle& operator=(GLHandle&& other)
+        {
+            if (this != &other)
+                reset(other.release());
+            return *this;
+        }
+
+        ~GLHandle()
+        {
+            reset();
+        }
+
+        // Generates a new object name
+        static GLHandle create()
+        {
+            return GLHandle(Traits::create());
+        }
+
+        GLuint get() const
+        {
+            return id;
+        }
+
+        explicit operator bool() const
+        {
+            return id != 0;
+        }
+
+        // Gives up ownership without deleting the object
+        GLuint release()
+        {
+            GLuint current = id;
+            id = 0;
+            return current;
+        }
+
+        void reset(GLuint newId = 0)
+        {
+            if (id != 0)
+                Traits::destroy(id);
+            id = newId;
+        }
+
+    private:
+        GLuint id;
+
+        GLHandle(const GLHandle&);
+        GLHandle& operator=(const GLHandle&);
+    };
+
+    struct BufferTraits
+    {
+        static GLuint create() { GLuint id; glGenBuffers(1, &id); return id; }
+        static void destroy(GLuint id) { glDeleteBuffers(1, &id); }
+    };
+
+    struct VertexArrayTraits
+    {
+        static GLuint create() { GLuint id; glGenVertexArrays(1, &id); return id; }
+        static void destroy(GLuint id) { glDeleteVertexArrays(1, &id); }
+    };
+
+    struct TextureTraits
+    {
+        static GLuint create() { GLuint id; glGenTextures(1, &id); return id; }
+        static void destroy(GLuint id) { glDeleteTextures(1, &id); }
+    };
+
+    struct FramebufferTraits
+    {
+        static GLuint create() { GLuint id; glGenFramebuffers(1, &id); return id; }
+        static void destroy(GLuint id) { glDeleteFramebuffers(1, &id); }
+    };
+
+    typedef GLHandle<BufferTraits> BufferHandle;
+    typedef GLHandle<VertexArrayTraits> VertexArrayHandle;
+    typedef GLHandle<TextureTraits> TextureHandle;
+    typedef GLHandle<FramebufferTraits> FramebufferHandle;
+}
+
+#endif /* GLHandle_hpp */
@@ -0,0 +1,115 @@
+#include "GLStateCache.hpp"
+#include "RenderStats.hpp"
+
+namespace gps {
+
+    GLStateCache& GLStateCache::Get()
+    {
+        static GLStateCache cache;
+        return cache;
+    }
+
+    GLStateCache::GLStateCache()
+    {
+        Invalidate();
+    }
+
+    void GLStateCache::UseProgram(GLuint program)
+    {
+        if (Change(this->program, program)) {
+            glUseProgram(program);
+            RenderStats::Get().Add(RenderStats::PROGRAM_BINDS);
+        }
+    }
+
+    void GLStateCache::BindVertexArray(GLuint vao)
+    {
+        if (Change(vertexArray, vao))
+            glBindVertexArray(vao);
+    }
+
+    // Binds the texture on the unit, the active unit only changes when a bind is issued
+    void GLStateCache::BindTexture(GLuint unit, GLenum target, GLuint texture)
+    {
+        int targetIndex = TargetIndex(target);
+        if (unit < MAX_UNITS && targetIndex >= 0) {
+            if (!Change(textures[unit][targetIndex], texture))
+                return;
+        }
+        else {
+            RenderStats::Get().Add(RenderStats::STATE_CALLS);
+        }
+
+        if (Change(activeUnit, unit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(target, texture);
+        RenderStats::Get().Add(RenderStats::TEXTURE_BINDS);
+    }
+
+    void GLStateCache::SetBlend(bool enabled)
+    {
+        SetCapability(GL_BLEND, blend, enabled);
+    }
+
+    void GLStateCache::SetCullFace(bool enabled)
+    {
+        SetCapability(GL_CULL_FACE, cullFace, enabled);
+    }
+
+    void GLStateCache::SetDepthFunc(GLenum func)
+    {
+        if (Change(depthFunc, func))
+            glDepthFunc(func);
+    }
+
+    // Forgets everything, the next call of every kind is issued
+    void GLStateCache::Invalidate()
+    {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (GLuint unit = 0; unit < MAX_UNITS; unit++) {
+            for (int target = 0; target < TARGET_COUNT; target++)
+                textures[unit][target] = UNKNOWN;
+        }
+        blend = UNKNOWN;
+        cullFace = UNKNOWN;
+        depthFunc = UNKNOWN;
+    }
+
+    int GLStateCache::TargetIndex(GLenum target)
+    {
+        switch (target) {
+        case GL_TEXTURE_2D:
+            return 0;
+        case GL_TEXTURE_2D_ARRAY:
+            return 1;
+        case GL_TEXTURE_CUBE_MAP:
+            return 2;
+        default:
+            return -1;
+        }
+    }
+
+    // records the value and tells whether the call has to be made
+    bool GLStateCache::Change(GLuint& current, GLuint value)
+    {
+        if (current == value) {
+            RenderStats::Get().Add(RenderStats::ELIDED_STATE_CALLS);
+            return false;
+        }
+        current = value;
+        RenderStats::Get().Add(RenderStats::STATE_CALLS);
+        return true;
+    }
+
+    void GLStateCache::SetCapability(GLenum capability, GLuint& current, bool enabled)
+    {
+        if (!Change(current, enabled ? 1 : 0))
+            return;
+        if (enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+    }
+}
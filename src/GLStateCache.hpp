@@ -0,0 +1,58 @@
+#ifndef GLStateCache_hpp
+#define GLStateCache_hpp
+
+#include <GL/glew.h>
+
+
+namespace gps {
+
+    // Shadow copy of the bound program, vertex array, textures, blending, face culling and depth
+    // function. A call that would set what is already current is dropped and only counted. Everything
+    // touching this state has to go through the cache, code that does not must call Invalidate after it.
+    // A deleted object stays recorded as bound, so its name must not be reused before an Invalidate.
+    class GLStateCache
+    {
+    public:
+        // The cache of the context, there is only one
+        static GLStateCache& Get();
+
+        void UseProgram(GLuint program);
+        void BindVertexArray(GLuint vao);
+
+        // Binds the texture on the unit, the active unit only changes when a bind is issued
+        void BindTexture(GLuint unit, GLenum target, GLuint texture);
+
+        void SetBlend(bool enabled);
+        void SetCullFace(bool enabled);
+        void SetDepthFunc(GLenum func);
+
+        // Forgets everything, the next call of every kind is issued
+        void Invalidate();
+
+    private:
+        static const GLuint UNKNOWN = 0xFFFFFFFF;
+        // units and targets beyond these are always issued
+        static const GLuint MAX_UNITS = 16;
+        static const int TARGET_COUNT = 3;
+
+        GLuint program;
+        GLuint vertexArray;
+        GLuint activeUnit;
+        GLuint textures[MAX_UNITS][TARGET_COUNT];
+        // 0 off, 1 on, UNKNOWN
+        GLuint blend;
+        GLuint cullFace;
+        GLenum depthFunc;
+
+        GLStateCache();
+
+        // index of a tracked texture target, -1 for the others
+        static int TargetIndex(GLenum target);
+
+        // records the value and tells whether the call has to be made
+        bool Change(GLuint& current, GLuint value);
+        void SetCapability(GLenum capability, GLuint& current, bool enabled);
+    };
+}
+
+#endif /* GLStateCache_hpp */
@@ -0,0 +1,241 @@
+#include "GeometryArena.hpp"
+#include "GLStateCache.hpp"
+#include "Mesh.hpp"
+#include "RenderStats.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+
+namespace gps {
+
+    void RangeAllocator::Reset(GLuint capacity)
+    {
+        freeRanges.clear();
+        this->capacity = capacity;
+        if (capacity > 0)
+            freeRanges[0] = capacity;
+    }
+
+    // First fit, the rest of the free range stays free
+    bool RangeAllocator::Allocate(GLuint size, GLuint& offset)
+    {
+        if (size == 0) {
+            offset = 0;
+            return true;
+        }
+
+        for (std::map<GLuint, GLuint>::iterator it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+            if (it->second < size)
+                continue;
+            offset = it->first;
+            GLuint remaining = it->second - size;
+            freeRanges.erase(it);
+            if (remaining > 0)
+                freeRanges[offset + size] = remaining;
+            return true;
+        }
+        return false;
+    }
+
+    // Gives the range back, merging it with the free ranges around it
+    void RangeAllocator::Free(GLuint offset, GLuint size)
+    {
+        if (size == 0)
+            return;
+
+        std::map<GLuint, GLuint>::iterator next = freeRanges.lower_bound(offset);
+        if (next != freeRanges.end() && offset + size == next->first) {
+            size += next->second;
+            next = freeRanges.erase(next);
+        }
+        if (next != freeRanges.begin()) {
+            std::map<GLuint, GLuint>::iterator previous = std::prev(next);
+            if (previous->first + previous->second == offset) {
+                previous->second += size;
+                return;
+            }
+        }
+        freeRanges[offset] = size;
+    }
+
+    // Adds free room at the end
+    void RangeAllocator::Grow(GLuint newCapacity)
+    {
+        if (newCapacity <= capacity)
+            return;
+        GLuint oldCapacity = capacity;
+        capacity = newCapacity;
+        Free(oldCapacity, newCapacity - oldCapacity);
+    }
+
+    GLuint RangeAllocator::GetCapacity() const
+    {
+        return capacity;
+    }
+
+    // The arena of the context. It is never destroyed, meshes held by globals still give their
+    // ranges back when the program exits.
+    GeometryArena& GeometryArena::Get()
+    {
+        static GeometryArena* arena = new GeometryArena();
+        return *arena;
+    }
+
+    GeometryArena::GeometryArena()
+    {
+    }
+
+    // Creates the buffers on first use
+    void GeometryArena::Init()
+    {
+        if (vertexBuffer)
+            return;
+
+        vertexSpace.Reset(INITIAL_VERTICES);
+        indexSpace.Reset(INITIAL_INDICES);
+
+        vertexBuffer = BufferHandle::create();
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer.get());
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)INITIAL_VERTICES * sizeof(Vertex), NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        indexBuffer = BufferHandle::create();
+        glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer.get());
+        glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)INITIAL_INDICES * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        sharedVAO = VertexArrayHandle::create();
+        vertexArrays.push_back(sharedVAO.get());
+        AttachBuffers(sharedVAO.get());
+    }
+
+    // Copies the mesh into free space, growing the buffers if there is none
+    GeometryRange GeometryArena::Allocate(const Vertex* vertices, GLuint vertexCount, const GLuint* indices, GLuint indexCount)
+    {
+        Init();
+
+        GLuint vertexOffset;
+        GLuint indexOffset;
+        bool grown = false;
+        while (!vertexSpace.Allocate(vertexCount, vertexOffset)) {
+            GLuint capacity = vertexSpace.GetCapacity();
+            GLuint newCapacity = std::max(capacity * 2, capacity + vertexCount);
+            GrowBuffer(vertexBuffer, (GLsizeiptr)capacity * sizeof(Vertex), (GLsizeiptr)newCapacity * sizeof(Vertex));
+            vertexSpace.Grow(newCapacity);
+            grown = true;
+        }
+        while (!indexSpace.Allocate(indexCount, indexOffset)) {
+            GLuint capacity = indexSpace.GetCapacity();
+            GLuint newCapacity = std::max(capacity * 2, capacity + indexCount);
+            GrowBuffer(indexBuffer, (GLsizeiptr)capacity * sizeof(GLuint), (GLsizeiptr)newCapacity * sizeof(GLuint));
+            indexSpace.Grow(newCapacity);
+            grown = true;
+        }
+        //the vertex arrays still point at the buffers that were replaced
+        if (grown) {
+            for (size_t i = 0; i < vertexArrays.size(); i++)
+                AttachBuffers(vertexArrays[i]);
+        }
+
+        //the indices are kept relative to the mesh, the base vertex moves them at draw time
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer.get());
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)vertexOffset * sizeof(Vertex), (GLsizeiptr)vertexCount * sizeof(Vertex), vertices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer.get());
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)indexOffset * sizeof(GLuint), (GLsizeiptr)indexCount * sizeof(GLuint), indices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        RenderStats::Get().Add(RenderStats::BUFFER_BYTES, (size_t)vertexCount * sizeof(Vertex) + (size_t)indexCount * sizeof(GLuint));
+
+        GeometryRange range;
+        range.baseVertex = (GLint)vertexOffset;
+        range.firstIndex = indexOffset;
+        range.vertexCount = vertexCount;
+        range.indexCount = indexCount;
+        return range;
+    }
+
+    // Returns the space of the range to the free lists
+    void GeometryArena::Free(const GeometryRange& range)
+    {
+        vertexSpace.Free((GLuint)range.baseVertex, range.vertexCount);
+        indexSpace.Free(range.firstIndex, range.indexCount);
+    }
+
+    GLuint GeometryArena::GetVertexArray()
+    {
+        Init();
+        return sharedVAO.get();
+    }
+
+    // New vertex array reading the arena, for meshes that add their own (instance) attributes
+    VertexArrayHandle GeometryArena::CreateVertexArray()
+    {
+        Init();
+        VertexArrayHandle vao = VertexArrayHandle::create();
+        vertexArrays.push_back(vao.get());
+        AttachBuffers(vao.get());
+        return vao;
+    }
+
+    void GeometryArena::ReleaseVertexArray(GLuint vao)
+    {
+        vertexArrays.erase(std::remove(vertexArrays.begin(), vertexArrays.end(), vao), vertexArrays.end());
+    }
+
+    // Feeds the draw ID attribute (location 8) of the shared vertex array
+    void GeometryArena::SetDrawIDBuffer(GLuint drawIDVBO)
+    {
+        GLStateCache::Get().BindVertexArray(GetVertexArray());
+        glBindBuffer(GL_ARRAY_BUFFER, drawIDVBO);
+
+        glEnableVertexAttribArray(8);
+        glVertexAttribIPointer(8, 1, GL_UNSIGNED_INT, sizeof(GLuint), (GLvoid*)0);
+        glVertexAttribDivisor(8, 1);
+
+        GLStateCache::Get().BindVertexArray(0);
+    }
+
+    GLuint GeometryArena::GetVertexBuffer() const
+    {
+        return vertexBuffer.get();
+    }
+
+    GLuint GeometryArena::GetIndexBuffer() const
+    {
+        return indexBuffer.get();
+    }
+
+    // Moves the contents into a buffer of the new size
+    void GeometryArena::GrowBuffer(BufferHandle& buffer, GLsizeiptr oldSize, GLsizeiptr newSize)
+    {
+        BufferHandle grown = BufferHandle::create();
+        glBindBuffer(GL_COPY_WRITE_BUFFER, grown.get());
+        glBufferData(GL_COPY_WRITE_BUFFER, newSize, NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer.get());
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldSize);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        buffer = std::move(grown);
+    }
+
+    // Points the vertex attributes 0-2 and the index buffer of the vertex array at the arena
+    void GeometryArena::AttachBuffers(GLuint vao)
+    {
+        GLStateCache::Get().BindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer.get());
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer.get());
+
+        // Vertex Positions
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+        // Vertex Normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
+        // Vertex Texture Coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+
+        GLStateCache::Get().BindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef GeometryArena_hpp
+#define GeometryArena_hpp
+
+#include "GLHandle.hpp"
+
+#include <map>
+#include <vector>
+
+namespace gps {
+
+    struct Vertex;
+
+    // First-fit allocator of ranges in [0, capacity), freed ranges merge with their free neighbours
+    class RangeAllocator
+    {
+    public:
+        void Reset(GLuint capacity);
+
+        // Returns false when no free range is long enough
+        bool Allocate(GLuint size, GLuint& offset);
+
+        // Gives the range back, merging it with the free ranges around it
+        void Free(GLuint offset, GLuint size);
+
+        // Adds free room at the end
+        void Grow(GLuint newCapacity);
+
+        GLuint GetCapacity() const;
+
+    private:
+        // offset -> size of every free range
+        std::map<GLuint, GLuint> freeRanges;
+        GLuint capacity = 0;
+    };
+
+    // Where a mesh lives in the arena
+    struct GeometryRange
+    {
+        GLint baseVertex = 0;
+        GLuint firstIndex = 0;
+        GLuint vertexCount = 0;
+        GLuint indexCount = 0;
+    };
+
+    // One vertex buffer and one index buffer holding the geometry of every mesh. Meshes keep the
+    // range they were given and draw with a base vertex and a first index, all of them through the
+    // same vertex array. The buffers grow when they are full, the vertex arrays reading them follow.
+    class GeometryArena
+    {
+    public:
+        // The arena of the context, there is only one
+        static GeometryArena& Get();
+
+        // Copies the mesh into free space, growing the buffers if there is none
+        GeometryRange Allocate(const Vertex* vertices, GLuint vertexCount, const GLuint* indices, GLuint indexCount);
+
+        // Returns the space of the range to the free lists
+        void Free(const GeometryRange& range);
+
+        // Vertex array shared by the meshes that need no attributes of their own
+        GLuint GetVertexArray();
+
+        // New vertex array reading the arena, for meshes that add their own (instance) attributes.
+        // It has to be given back with ReleaseVertexArray before it is deleted.
+        VertexArrayHandle CreateVertexArray();
+        void ReleaseVertexArray(GLuint vao);
+
+        // Feeds the draw ID attribute (location 8) of the shared vertex array, see gps::TransformRing
+        void SetDrawIDBuffer(GLuint drawIDVBO);
+
+        GLuint GetVertexBuffer() const;
+        GLuint GetIndexBuffer() const;
+
+    private:
+        // sizes the buffers start with, in vertices and indices
+        static const GLuint INITIAL_VERTICES = 1 << 18;
+        static const GLuint INITIAL_INDICES = 3 << 18;
+
+        BufferHandle vertexBuffer;
+        BufferHandle indexBuffer;
+        RangeAllocator vertexSpace;
+        RangeAllocator indexSpace;
+
+        VertexArrayHandle sharedVAO;
+        // every vertex array reading the buffers, the shared one included
+        std::vector<GLuint> vertexArrays;
+
+        GeometryArena();
+
+        // Creates the buffers on first use
+        void Init();
+
+        // Moves the contents into a buffer of the new size
+        static void GrowBuffer(BufferHandle& buffer, GLsizeiptr oldSize, GLsizeiptr newSize);
+
+        // Points the vertex attributes 0-2 and the index buffer of the vertex array at the arena
+        void AttachBuffers(GLuint vao);
+    };
+}
+
+#endif /* GeometryArena_hpp */
@@ -0,0 +1,178 @@
+#include "GpuProfiler.hpp"
+
+#include <algorithm>
+
+namespace gps {
+
+    GpuProfiler& GpuProfiler::Get()
+    {
+        static GpuProfiler profiler;
+        return profiler;
+    }
+
+    GpuProfiler::GpuProfiler() : initialized(false), frame(0), recording(false)
+    {
+        for (int i = 0; i < FRAME_LATENCY; i++)
+            frames[i].pending = false;
+    }
+
+    GpuProfiler::~GpuProfiler()
+    {
+        if (initialized) {
+            for (int i = 0; i < FRAME_LATENCY; i++)
+                glDeleteQueries(MAX_SCOPES * 2, frames[i].queries);
+        }
+    }
+
+    // Creates the queries, needs the context
+    void GpuProfiler::Init()
+    {
+        if (initialized)
+            return;
+        for (int i = 0; i < FRAME_LATENCY; i++) {
+            glGenQueries(MAX_SCOPES * 2, frames[i].queries);
+            frames[i].scopes.reserve(MAX_SCOPES);
+        }
+        initialized = true;
+    }
+
+    // Reads the oldest frame of the ring and opens the "frame" scope
+    void GpuProfiler::BeginFrame()
+    {
+        recording = false;
+        openScopes.clear();
+        if (!initialized)
+            return;
+
+        FrameQueries& queries = frames[frame];
+        if (queries.pending) {
+            //the frame scope ends last, once it is there every other result is as well
+            GLint available = 0;
+            glGetQueryObjectiv(queries.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                return;
+            Resolve(queries);
+        }
+
+        queries.scopes.clear();
+        recording = true;
+        BeginScope("frame");
+    }
+
+    // Closes the "frame" scope, call after the last draw of the frame
+    void GpuProfiler::EndFrame()
+    {
+        if (!recording)
+            return;
+
+        while (!openScopes.empty())
+            EndScope();
+        frames[frame].pending = true;
+        frame = (frame + 1) % FRAME_LATENCY;
+        recording = false;
+    }
+
+    void GpuProfiler::BeginScope(const char* name)
+    {
+        FrameQueries& queries = frames[frame];
+        if (!recording || queries.scopes.size() >= MAX_SCOPES) {
+            openScopes.push_back(-1);
+            return;
+        }
+
+        int index = (int)queries.scopes.size();
+        ScopeRecord record;
+        record.depth = (int)openScopes.size();
+        record.timing = FindTiming(name, record.depth);
+        queries.scopes.push_back(record);
+        openScopes.push_back(index);
+        glQueryCounter(queries.queries[index * 2], GL_TIMESTAMP);
+    }
+
+    void GpuProfiler::EndScope()
+    {
+        if (openScopes.empty())
+            return;
+
+        int index = openScopes.back();
+        openScopes.pop_back();
+        if (index >= 0)
+            glQueryCounter(frames[frame].queries[index * 2 + 1], GL_TIMESTAMP);
+    }
+
+    // Timings of every scope seen so far, in the order they first appeared
+    const std::vector<GpuTiming>& GpuProfiler::GetTimings() const
+    {
+        return timings;
+    }
+
+    // Average of the scope in milliseconds, 0 for a scope never measured
+    double GpuProfiler::GetAverage(const std::string& name) const
+    {
+        for (size_t i = 0; i < timings.size(); i++) {
+            if (timings[i].name == name)
+                return timings[i].averageMs;
+        }
+        return 0.0;
+    }
+
+    // Writes the averages as an indented table
+    void GpuProfiler::Print(FILE* out) const
+    {
+        fprintf(out, "GPU time, average of the last %d frames\n", AVERAGE_FRAMES);
+        for (size_t i = 0; i < timings.size(); i++) {
+            const GpuTiming& timing = timings[i];
+            fprintf(out, "%*s%-*s %8.3f ms\n", timing.depth * 2, "", 24 - timing.depth * 2, timing.name.c_str(), timing.averageMs);
+        }
+    }
+
+    size_t GpuProfiler::FindTiming(const char* name, int depth)
+    {
+        for (size_t i = 0; i < timings.size(); i++) {
+            if (timings[i].depth == depth && timings[i].name == name)
+                return i;
+        }
+
+        GpuTiming timing;
+        timing.name = name;
+        timing.depth = depth;
+        timing.lastMs = 0.0;
+        timing.averageMs = 0.0;
+        timings.push_back(timing);
+        samples.push_back(std::vector<double>(AVERAGE_FRAMES, 0.0));
+        sampleCounts.push_back(0);
+        return timings.size() - 1;
+    }
+
+    // Adds the times of a finished frame to the averages, a scope entered several times counts with its total
+    void GpuProfiler::Resolve(FrameQueries& queries)
+    {
+        std::vector<double> frameTimes(timings.size(), -1.0);
+        for (size_t i = 0; i < queries.scopes.size(); i++) {
+            GLuint64 start = 0;
+            GLuint64 end = 0;
+            glGetQueryObjectui64v(queries.queries[i * 2], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(queries.queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+
+            double& time = frameTimes[queries.scopes[i].timing];
+            time = std::max(time, 0.0) + (double)(end - start) / 1.0e6;
+        }
+
+        for (size_t index = 0; index < frameTimes.size(); index++) {
+            if (frameTimes[index] < 0.0)
+                continue;
+
+            std::vector<double>& history = samples[index];
+            history[sampleCounts[index] % AVERAGE_FRAMES] = frameTimes[index];
+            sampleCounts[index]++;
+
+            size_t count = std::min(sampleCounts[index], (size_t)AVERAGE_FRAMES);
+            double total = 0.0;
+            for (size_t j = 0; j < count; j++)
+                total += history[j];
+            timings[index].lastMs = frameTimes[index];
+            timings[index].averageMs = total / count;
+        }
+        queries.pending = false;
+    }
+}
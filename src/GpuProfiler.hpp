@@ -0,0 +1,120 @@
+#ifndef GpuProfiler_hpp
+#define GpuProfiler_hpp
+
+#include "GLHandle.hpp"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // GPU time of a named scope, averaged over the last AVERAGE_FRAMES measured frames
+    struct GpuTiming
+    {
+        std::string name;
+        // nesting level, 0 is the whole frame
+        int depth;
+        double lastMs;
+        double averageMs;
+    };
+
+    // GPU times of named scopes of the frame, from a timestamp query at each end of a scope. Every
+    // frame writes its queries into its own set of a ring and the set is read FRAME_LATENCY frames
+    // later, when the GPU is long done with it. A frame whose set is still not done is not measured
+    // rather than waited for, so reading the results never stalls.
+    class GpuProfiler
+    {
+    public:
+        static const int FRAME_LATENCY = 4;
+        static const int MAX_SCOPES = 32;
+        static const int AVERAGE_FRAMES = 64;
+
+        // The profiler of the context, there is only one
+        static GpuProfiler& Get();
+
+        // Creates the queries, needs the context
+        void Init();
+
+        // Reads the oldest frame of the ring and opens the "frame" scope
+        void BeginFrame();
+
+        // Closes the "frame" scope, call after the last draw of the frame
+        void EndFrame();
+
+        // Scopes nest, a scope has to end before the one around it.
+        // Scopes beyond MAX_SCOPES in a frame are not measured.
+        void BeginScope(const char* name);
+        void EndScope();
+
+        // Timings of every scope seen so far, in the order they first appeared
+        const std::vector<GpuTiming>& GetTimings() const;
+
+        // Average of the scope in milliseconds, 0 for a scope never measured
+        double GetAverage(const std::string& name) const;
+
+        // Writes the averages as an indented table
+        void Print(FILE* out) const;
+
+    private:
+        struct ScopeRecord
+        {
+            // index into timings
+            size_t timing;
+            int depth;
+        };
+
+        struct FrameQueries
+        {
+            // start and end timestamp of every scope
+            GLuint queries[MAX_SCOPES * 2];
+            std::vector<ScopeRecord> scopes;
+            bool pending;
+        };
+
+        bool initialized;
+        FrameQueries frames[FRAME_LATENCY];
+        int frame;
+        // whether this frame got a query set
+        bool recording;
+        // scopes currently open, -1 for the ones not measured
+        std::vector<int> openScopes;
+
+        std::vector<GpuTiming> timings;
+        // last AVERAGE_FRAMES times of every timing
+        std::vector<std::vector<double> > samples;
+        std::vector<size_t> sampleCounts;
+
+        GpuProfiler();
+        ~GpuProfiler();
+
+        size_t FindTiming(const char* name, int depth);
+
+        // Adds the times of a finished frame to the averages
+        void Resolve(FrameQueries& queries);
+
+        GpuProfiler(const GpuProfiler&);
+        GpuProfiler& operator=(const GpuProfiler&);
+    };
+
+    // Measures the GPU time until the end of the enclosing block
+    class GpuScope
+    {
+    public:
+        explicit GpuScope(const char* name)
+        {
+            GpuProfiler::Get().BeginScope(name);
+        }
+
+        ~GpuScope()
+        {
+            GpuProfiler::Get().EndScope();
+        }
+
+    private:
+        GpuScope(const GpuScope&);
+        GpuScope& operator=(const GpuScope&);
+    };
+}
+
+#endif /* GpuProfiler_hpp */
@@ -0,0 +1,183 @@
+#include "HeadlessContext.hpp"
+
+#ifdef GPS_HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <cstdio>
+
+namespace gps {
+
+    HeadlessContext::HeadlessContext()
+        : display(NULL), context(NULL), width(0), height(0), framebuffer(0), colorBuffer(0), depthBuffer(0)
+    {
+    }
+
+    HeadlessContext::~HeadlessContext()
+    {
+        Destroy();
+    }
+
+    // Makes the context current, loads the GL functions and creates the framebuffer
+    bool HeadlessContext::Create(int width, int height)
+    {
+        if (width <= 0 || height <= 0) {
+            fprintf(stderr, "ERROR: invalid headless framebuffer size %dx%d\n", width, height);
+            return false;
+        }
+        this->width = width;
+        this->height = height;
+
+        if (!CreateContext())
+            return false;
+
+        //glewInit looks for a GLX/WGL display as well, there is none here so only the GL entry points are loaded
+        glewExperimental = GL_TRUE;
+        if (glewContextInit() != GLEW_OK) {
+            fprintf(stderr, "ERROR: could not load the OpenGL functions\n");
+            Destroy();
+            return false;
+        }
+
+        if (!CreateFramebuffer()) {
+            Destroy();
+            return false;
+        }
+        return true;
+    }
+
+#ifdef GPS_HEADLESS_EGL
+    bool HeadlessContext::CreateContext()
+    {
+        //Mesa's surfaceless platform needs neither a GPU nor a display server
+        EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay != NULL)
+            eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (eglDisplay == EGL_NO_DISPLAY)
+            eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+        EGLint major, minor;
+        if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor)) {
+            fprintf(stderr, "ERROR: could not initialize EGL\n");
+            return false;
+        }
+        display = eglDisplay;
+
+        const EGLint configAttributes[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint configCount = 0;
+        if (!eglChooseConfig(eglDisplay, configAttributes, &config, 1, &configCount) || configCount == 0) {
+            fprintf(stderr, "ERROR: no EGL config supports desktop OpenGL\n");
+            Destroy();
+            return false;
+        }
+
+        if (!eglBindAPI(EGL_OPENGL_API)) {
+            fprintf(stderr, "ERROR: EGL does not support desktop OpenGL\n");
+            Destroy();
+            return false;
+        }
+
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 4,
+            EGL_CONTEXT_MINOR_VERSION, 4,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        EGLContext eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+        if (eglContext == EGL_NO_CONTEXT) {
+            fprintf(stderr, "ERROR: could not create an OpenGL 4.4 core context with EGL\n");
+            Destroy();
+            return false;
+        }
+        context = eglContext;
+
+        //no surface at all, everything is drawn into the framebuffer
+        if (!eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext)) {
+            fprintf(stderr, "ERROR: could not make the EGL context current\n");
+            Destroy();
+            return false;
+        }
+
+        printf("EGL version %d.%d\n", major, minor);
+        return true;
+    }
+
+    // Deletes the framebuffer and releases the context
+    void HeadlessContext::Destroy()
+    {
+        if (context != NULL) {
+            glDeleteFramebuffers(1, &framebuffer);
+            glDeleteRenderbuffers(1, &colorBuffer);
+            glDeleteRenderbuffers(1, &depthBuffer);
+            eglMakeCurrent((EGLDisplay)display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglDestroyContext((EGLDisplay)display, (EGLContext)context);
+        }
+        if (display != NULL)
+            eglTerminate((EGLDisplay)display);
+
+        display = NULL;
+        context = NULL;
+        framebuffer = 0;
+        colorBuffer = 0;
+        depthBuffer = 0;
+    }
+#else
+    bool HeadlessContext::CreateContext()
+    {
+        fprintf(stderr, "ERROR: built without headless support, use the CMake build (GPS_HEADLESS_EGL, links with EGL)\n");
+        return false;
+    }
+
+    void HeadlessContext::Destroy()
+    {
+    }
+#endif
+
+    // Color and depth like the default framebuffer of the window, sRGB so GL_FRAMEBUFFER_SRGB applies the same way
+    bool HeadlessContext::CreateFramebuffer()
+    {
+        glGenRenderbuffers(1, &colorBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_SRGB8_ALPHA8, width, height);
+
+        glGenRenderbuffers(1, &depthBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        if (status != GL_FRAMEBUFFER_COMPLETE) {
+            fprintf(stderr, "ERROR: headless framebuffer is incomplete (0x%x)\n", status);
+            return false;
+        }
+        return true;
+    }
+
+    GLuint HeadlessContext::GetFramebuffer() const
+    {
+        return framebuffer;
+    }
+
+    int HeadlessContext::GetWidth() const
+    {
+        return width;
+    }
+
+    int HeadlessContext::GetHeight() const
+    {
+        return height;
+    }
+}
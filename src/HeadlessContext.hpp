@@ -0,0 +1,49 @@
+#ifndef HeadlessContext_hpp
+#define HeadlessContext_hpp
+
+#include "GLHandle.hpp"
+
+namespace gps {
+
+    // OpenGL 4.4 core context without a window or a display, for running the renderer on machines
+    // that have neither (CI, render farms, Mesa llvmpipe). The context comes from surfaceless EGL and
+    // draws into a framebuffer of the given size that stands in for the window. Only built when
+    // GPS_HEADLESS_EGL is defined (link with -lEGL), Create fails otherwise.
+    class HeadlessContext
+    {
+    public:
+        HeadlessContext();
+        ~HeadlessContext();
+
+        // Makes the context current, loads the GL functions and creates the framebuffer.
+        // Returns false, with the reason on stderr, when any of it fails.
+        bool Create(int width, int height);
+
+        // Framebuffer to render the frame into instead of 0
+        GLuint GetFramebuffer() const;
+
+        int GetWidth() const;
+        int GetHeight() const;
+
+        // Deletes the framebuffer and releases the context
+        void Destroy();
+
+    private:
+        void* display;
+        void* context;
+        int width;
+        int height;
+
+        GLuint framebuffer;
+        GLuint colorBuffer;
+        GLuint depthBuffer;
+
+        bool CreateContext();
+        bool CreateFramebuffer();
+
+        HeadlessContext(const HeadlessContext&);
+        HeadlessContext& operator=(const HeadlessContext&);
+    };
+}
+
+#endif /* HeadlessContext_hpp */
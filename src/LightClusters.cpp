@@ -0,0 +1,162 @@
+#include "LightClusters.hpp"
+#include "RenderStats.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+    namespace {
+
+        // Allocates the buffer for this frame's data, orphaning the storage the GPU may still read
+        template <class T>
+        void uploadStorage(const gps::BufferHandle& buffer, const std::vector<T>& data)
+        {
+            // zero sized buffers cannot be bound as storage, keep at least one element
+            T empty = T();
+            const T* source = data.empty() ? &empty : data.data();
+            size_t size = std::max<size_t>(data.size(), 1) * sizeof(T);
+
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer.get());
+            glBufferData(GL_SHADER_STORAGE_BUFFER, size, source, GL_STREAM_DRAW);
+            RenderStats::Get().Add(RenderStats::BUFFER_BYTES, size);
+        }
+    }
+
+    // Creates the buffers and the froxel bounds of a perspective projection
+    void LightClusters::Init(int width, int height, float fovy, float zNear, float zFar, float sliceFar)
+    {
+        this->width = width;
+        this->height = height;
+        this->zNear = zNear;
+        this->zFar = zFar;
+
+        float logRange = std::log(sliceFar / zNear);
+        depthScale = GRID_Z / logRange;
+        depthBias = -GRID_Z * std::log(zNear) / logRange;
+
+        //a froxel is the box around the part of its tile between the depths of its slice
+        float tanHalfY = std::tan(fovy * 0.5f);
+        float tanHalfX = tanHalfY * width / (float)height;
+        clusterBounds.resize(CLUSTER_COUNT);
+        for (int z = 0; z < GRID_Z; z++) {
+            float depthNear = zNear * std::pow(sliceFar / zNear, z / (float)GRID_Z);
+            float depthFar = z == GRID_Z - 1 ? zFar : zNear * std::pow(sliceFar / zNear, (z + 1) / (float)GRID_Z);
+            for (int y = 0; y < GRID_Y; y++) {
+                float y0 = (-1.0f + 2.0f * y / GRID_Y) * tanHalfY;
+                float y1 = (-1.0f + 2.0f * (y + 1) / GRID_Y) * tanHalfY;
+                for (int x = 0; x < GRID_X; x++) {
+                    float x0 = (-1.0f + 2.0f * x / GRID_X) * tanHalfX;
+                    float x1 = (-1.0f + 2.0f * (x + 1) / GRID_X) * tanHalfX;
+
+                    AABB& bounds = clusterBounds[(z * GRID_Y + y) * GRID_X + x];
+                    bounds.min = glm::vec3(std::min(x0 * depthNear, x0 * depthFar),
+                                           std::min(y0 * depthNear, y0 * depthFar),
+                                           -depthFar);
+                    bounds.max = glm::vec3(std::max(x1 * depthNear, x1 * depthFar),
+                                           std::max(y1 * depthNear, y1 * depthFar),
+                                           -depthNear);
+                }
+            }
+        }
+
+        lightBuffer = gps::BufferHandle::create();
+        clusterBuffer = gps::BufferHandle::create();
+        indexBuffer = gps::BufferHandle::create();
+        ranges.assign(CLUSTER_COUNT, ClusterRange());
+    }
+
+    // Bins the lights (world space) against the froxels of the given view and uploads the result
+    void LightClusters::Update(const std::vector<PointLight>& lights, const glm::mat4& view)
+    {
+        gpuLights.resize(lights.size());
+        pairClusters.clear();
+        pairLights.clear();
+
+        for (size_t i = 0; i < lights.size(); i++) {
+            const PointLight& light = lights[i];
+            float radius = LightRadius(light);
+
+            GPULight& gpuLight = gpuLights[i];
+            gpuLight.positionRadius = glm::vec4(light.position, radius);
+            gpuLight.color = glm::vec4(light.color, 1.0f);
+            gpuLight.attenuation = glm::vec4(light.constant, light.linear, light.quadratic, 0.0f);
+
+            glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+            float depth = -center.z;
+            if (depth + radius < zNear || depth - radius > zFar)
+                continue;
+
+            //only the slices the sphere reaches, every tile of those is tested against the sphere
+            int firstSlice = SliceOf(std::max(depth - radius, zNear));
+            int lastSlice = SliceOf(depth + radius);
+            for (int z = firstSlice; z <= lastSlice; z++) {
+                for (int cluster = z * GRID_X * GRID_Y; cluster < (z + 1) * GRID_X * GRID_Y; cluster++) {
+                    const AABB& bounds = clusterBounds[cluster];
+                    glm::vec3 closest = glm::clamp(center, bounds.min, bounds.max);
+                    glm::vec3 offset = closest - center;
+                    if (glm::dot(offset, offset) <= radius * radius) {
+                        pairClusters.push_back(cluster);
+                        pairLights.push_back((GLuint)i);
+                    }
+                }
+            }
+        }
+
+        //counting sort of the pairs by cluster
+        for (int cluster = 0; cluster < CLUSTER_COUNT; cluster++)
+            ranges[cluster].count = 0;
+        for (size_t i = 0; i < pairClusters.size(); i++)
+            ranges[pairClusters[i]].count++;
+        GLuint offset = 0;
+        for (int cluster = 0; cluster < CLUSTER_COUNT; cluster++) {
+            ranges[cluster].offset = offset;
+            offset += ranges[cluster].count;
+            ranges[cluster].count = 0;
+        }
+        indices.resize(pairClusters.size());
+        for (size_t i = 0; i < pairClusters.size(); i++) {
+            ClusterRange& range = ranges[pairClusters[i]];
+            indices[range.offset + range.count++] = pairLights[i];
+        }
+
+        uploadStorage(lightBuffer, gpuLights);
+        uploadStorage(clusterBuffer, ranges);
+        uploadStorage(indexBuffer, indices);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    // Binds the three storage buffers
+    void LightClusters::Bind()
+    {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_BINDING, lightBuffer.get());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_BINDING, clusterBuffer.get());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INDEX_BINDING, indexBuffer.get());
+    }
+
+    glm::vec4 LightClusters::GetShaderParams() const
+    {
+        return glm::vec4(width / (float)GRID_X, height / (float)GRID_Y, depthScale, depthBias);
+    }
+
+    int LightClusters::SliceOf(float depth) const
+    {
+        int slice = (int)std::floor(std::log(depth) * depthScale + depthBias);
+        return std::min(std::max(slice, 0), GRID_Z - 1);
+    }
+
+    // Solves color * attenuation(d) = 1/256 for the distance d
+    float LightClusters::LightRadius(const PointLight& light)
+    {
+        float brightest = std::max(light.color.x, std::max(light.color.y, light.color.z));
+        float c = light.constant - 256.0f * brightest;
+        if (c >= 0.0f)
+            return 0.0f;
+        if (light.quadratic > 0.0f)
+            return (-light.linear + std::sqrt(light.linear * light.linear - 4.0f * light.quadratic * c)) / (2.0f * light.quadratic);
+        if (light.linear > 0.0f)
+            return -c / light.linear;
+        //no falloff, the light reaches everything
+        return 1e30f;
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef LightClusters_hpp
+#define LightClusters_hpp
+
+#include "GLHandle.hpp"
+#include "Frustum.hpp"
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    struct PointLight
+    {
+        glm::vec3 position;
+        float constant;
+        float linear;
+        float quadratic;
+        glm::vec3 color;
+    };
+
+    // Clustered forward lighting: the view frustum is split into a grid of froxels (screen tiles
+    // times exponential depth slices) and every frame the point lights are binned into the froxels
+    // they reach. The lights, the per-froxel ranges and the light index list live in shader storage
+    // buffers, so a fragment only evaluates the lights of its own froxel.
+    class LightClusters
+    {
+    public:
+        // Has to match the CLUSTER_X/Y/Z defines of shaderStart.frag
+        static const int GRID_X = 16;
+        static const int GRID_Y = 9;
+        static const int GRID_Z = 24;
+        static const int CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+
+        // Shader storage binding points of the three buffers
+        static const GLuint LIGHT_BINDING = 0;
+        static const GLuint CLUSTER_BINDING = 1;
+        static const GLuint INDEX_BINDING = 2;
+
+        // Creates the buffers and the froxel bounds of a perspective projection. The depth slices
+        // are spread up to sliceFar, the last one also takes everything behind it up to zFar.
+        void Init(int width, int height, float fovy, float zNear, float zFar, float sliceFar);
+
+        // Bins the lights (world space) against the froxels of the given view and uploads the result
+        void Update(const std::vector<PointLight>& lights, const glm::mat4& view);
+
+        // Binds the three storage buffers
+        void Bind();
+
+        // What the shader needs to find the froxel of a fragment:
+        // tile width and height in pixels, scale and bias of the log depth slices
+        glm::vec4 GetShaderParams() const;
+
+    private:
+        // std430 layout of a light in the storage buffer
+        struct GPULight
+        {
+            glm::vec4 positionRadius;
+            glm::vec4 color;
+            // constant, linear, quadratic, unused
+            glm::vec4 attenuation;
+        };
+
+        // offset and length of the froxel's range in the index list
+        struct ClusterRange
+        {
+            GLuint offset;
+            GLuint count;
+        };
+
+        gps::BufferHandle lightBuffer;
+        gps::BufferHandle clusterBuffer;
+        gps::BufferHandle indexBuffer;
+
+        int width = 0;
+        int height = 0;
+        float zNear = 0.1f;
+        float zFar = 1000.0f;
+        // slice = log(depth) * depthScale + depthBias
+        float depthScale = 0.0f;
+        float depthBias = 0.0f;
+
+        // view-space bounds of every froxel, x fastest, then y, then z
+        std::vector<AABB> clusterBounds;
+
+        std::vector<GPULight> gpuLights;
+        std::vector<ClusterRange> ranges;
+        std::vector<GLuint> indices;
+        // (cluster, light) pairs found by the binning, grouped by cluster afterwards
+        std::vector<GLuint> pairClusters;
+        std::vector<GLuint> pairLights;
+
+        int SliceOf(float depth) const;
+        // distance after which a light adds less than one step of an 8 bit channel
+        static float LightRadius(const PointLight& light);
+    };
+}
+
+#endif /* LightClusters_hpp */
@@ -0,0 +1,114 @@
+#include "MappedFile.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace gps {
+
+#ifdef _WIN32
+    MappedFile::MappedFile() : data(NULL), size(0), fileHandle(INVALID_HANDLE_VALUE), mappingHandle(NULL)
+    {
+    }
+#else
+    MappedFile::MappedFile() : data(NULL), size(0), fileDescriptor(-1)
+    {
+    }
+#endif
+
+    MappedFile::~MappedFile()
+    {
+        Close();
+    }
+
+    // Maps fileName into memory, returns false if it cannot be opened
+    bool MappedFile::Open(const std::string& fileName)
+    {
+        Close();
+
+#ifdef _WIN32
+        fileHandle = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (fileHandle == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(fileHandle, &fileSize)) {
+            Close();
+            return false;
+        }
+        size = (size_t)fileSize.QuadPart;
+        //empty files cannot be mapped, but they are valid
+        if (size == 0)
+            return true;
+
+        mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mappingHandle == NULL) {
+            Close();
+            return false;
+        }
+        data = (const char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+#else
+        fileDescriptor = open(fileName.c_str(), O_RDONLY);
+        if (fileDescriptor == -1)
+            return false;
+
+        struct stat fileStat;
+        if (fstat(fileDescriptor, &fileStat) != 0) {
+            Close();
+            return false;
+        }
+        size = (size_t)fileStat.st_size;
+        //empty files cannot be mapped, but they are valid
+        if (size == 0)
+            return true;
+
+        void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+        data = mapping == MAP_FAILED ? NULL : (const char*)mapping;
+#endif
+
+        if (data == NULL) {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void MappedFile::Close()
+    {
+#ifdef _WIN32
+        if (data != NULL)
+            UnmapViewOfFile(data);
+        if (mappingHandle != NULL)
+            CloseHandle(mappingHandle);
+        if (fileHandle != INVALID_HANDLE_VALUE)
+            CloseHandle(fileHandle);
+        mappingHandle = NULL;
+        fileHandle = INVALID_HANDLE_VALUE;
+#else
+        if (data != NULL)
+            munmap((void*)data, size);
+        if (fileDescriptor != -1)
+            close(fileDescriptor);
+        fileDescriptor = -1;
+#endif
+        data = NULL;
+        size = 0;
+    }
+
+    const char* MappedFile::Data() const
+    {
+        return data;
+    }
+
+    size_t MappedFile::Size() const
+    {
+        return size;
+    }
+}
@@ -1,71 +1,174 @@
 #include "Mesh.hpp"
+#include "GLStateCache.hpp"
+#include "RenderStats.hpp"
+
 namespace gps {
 
 	/* Mesh Constructor */
-	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures)
+	Mesh::Mesh(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, std::vector<Texture> textures)
 	{
-		this->vertices = vertices;
-		this->indices = indices;
 		this->textures = textures;
 
-		this->setupMesh();
+		this->setupMesh(vertices.data(), vertices.size(), indices.data(), indices.size());
+	}
+
+	Mesh::Mesh(const Vertex* vertices, GLuint vertexCount, const GLuint* indices, GLuint indexCount, std::vector<Texture> textures)
+	{
+		this->textures = textures;
+
+		this->setupMesh(vertices, vertexCount, indices, indexCount);
+	}
+
+	MeshBuffers::~MeshBuffers() {
+		if (instanceVAO)
+			GeometryArena::Get().ReleaseVertexArray(instanceVAO.get());
+		GeometryArena::Get().Free(geometry);
 	}
 
 	Buffers Mesh::getBuffers() {
-	    return this->buffers;
+		Buffers names;
+		names.VAO = this->vertexArray();
+		names.VBO = GeometryArena::Get().GetVertexBuffer();
+		names.EBO = GeometryArena::Get().GetIndexBuffer();
+		return names;
+	}
+
+	const AABB& Mesh::getBounds() const {
+		return this->buffers->bounds;
+	}
+
+	const BoundingSphere& Mesh::getBoundingSphere() const {
+		return this->buffers->sphere;
+	}
+
+	GLsizei Mesh::getIndexCount() const {
+		return (GLsizei)this->buffers->geometry.indexCount;
+	}
+
+	const GeometryRange& Mesh::getGeometry() const {
+		return this->buffers->geometry;
 	}
 
 	/* Mesh drawing function - also applies associated textures */
-	void Mesh::Draw(gps::Shader shader)
+	void Mesh::Draw(gps::Shader& shader, GLuint drawID)
+	{
+		shader.useShaderProgram();
+		this->bindTextures(shader);
+
+		// the vertex array and textures stay bound, the next mesh only changes what differs
+		GLStateCache::Get().BindVertexArray(this->vertexArray());
+		// a single instance, the base instance picks the entry of the draw ID buffer
+		this->drawElements(1, drawID);
+	}
+
+	/* Instanced drawing function - the model matrices come from the instance buffer */
+	void Mesh::DrawInstanced(gps::Shader& shader, GLsizei instanceCount)
 	{
 		shader.useShaderProgram();
+		this->bindTextures(shader);
+
+		GLStateCache::Get().BindVertexArray(this->vertexArray());
+		this->drawElements(instanceCount, 0);
+	}
+
+	// Issues only the draw call, the range of the mesh is found through the base vertex and first index
+	void Mesh::drawElements(GLsizei instanceCount, GLuint baseInstance)
+	{
+		const GeometryRange& geometry = this->buffers->geometry;
+		glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, (GLsizei)geometry.indexCount, GL_UNSIGNED_INT,
+			(GLvoid*)(geometry.firstIndex * sizeof(GLuint)), instanceCount, geometry.baseVertex, baseInstance);
+
+		RenderStats& stats = RenderStats::Get();
+		stats.Add(RenderStats::DRAW_CALLS);
+		stats.Add(RenderStats::TRIANGLES, (size_t)geometry.indexCount / 3 * instanceCount);
+		stats.Add(RenderStats::VERTICES, (size_t)geometry.indexCount * instanceCount);
+	}
 
-		//set textures
+	void Mesh::bindTextures(gps::Shader& shader)
+	{
+		GLStateCache& state = GLStateCache::Get();
 		for (GLuint i = 0; i < textures.size(); i++)
 		{
-			glActiveTexture(GL_TEXTURE0 + i);
-			glUniform1i(glGetUniformLocation(shader.shaderProgram, this->textures[i].type.c_str()), i);
-			glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
+			shader.setInt(this->textures[i].typeHash, i);
+			state.BindTexture(i, GL_TEXTURE_2D, this->textures[i].handle->get());
+		}
+		// units a mesh with more textures left behind are cleared, so missing maps still read as black
+		for (GLuint i = (GLuint)textures.size(); i < MAX_TEXTURES; i++)
+			state.BindTexture(i, GL_TEXTURE_2D, 0);
+	}
+
+	// Binds a buffer of per-instance model matrices to attribute locations 3-6
+	void Mesh::setupInstanceAttributes(GLuint instanceVBO)
+	{
+		GLStateCache::Get().BindVertexArray(this->instanceVertexArray());
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+
+		// a mat4 attribute takes up four consecutive vec4 locations
+		for (GLuint i = 0; i < 4; i++)
+		{
+			glEnableVertexAttribArray(3 + i);
+			glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(i * sizeof(glm::vec4)));
+			glVertexAttribDivisor(3 + i, 1);
+		}
+
+		GLStateCache::Get().BindVertexArray(0);
+	}
+
+	// Binds a buffer of per-instance particle positions (vec4) to attribute location 7
+	void Mesh::setupParticleAttribute(GLuint particleVBO)
+	{
+		GLStateCache::Get().BindVertexArray(this->instanceVertexArray());
+		glBindBuffer(GL_ARRAY_BUFFER, particleVBO);
+
+		glEnableVertexAttribArray(7);
+		glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (GLvoid*)0);
+		glVertexAttribDivisor(7, 1);
+
+		GLStateCache::Get().BindVertexArray(0);
+	}
+
+	// Copies the geometry into the arena
+	void Mesh::setupMesh(const Vertex* vertices, GLuint vertexCount, const GLuint* indices, GLuint indexCount){
+		this->buffers = std::make_shared<MeshBuffers>();
+		this->buffers->geometry = GeometryArena::Get().Allocate(vertices, vertexCount, indices, indexCount);
+		this->computeBounds(vertices, vertexCount);
+	}
+
+	GLuint Mesh::vertexArray() const
+	{
+		if (this->buffers->instanceVAO)
+			return this->buffers->instanceVAO.get();
+		return GeometryArena::Get().GetVertexArray();
+	}
+
+	// Moves the mesh to a vertex array of its own, so it can take instance attributes
+	GLuint Mesh::instanceVertexArray()
+	{
+		if (!this->buffers->instanceVAO)
+			this->buffers->instanceVAO = GeometryArena::Get().CreateVertexArray();
+		return this->buffers->instanceVAO.get();
+	}
+
+	// Fits the box and the sphere around the vertices
+	void Mesh::computeBounds(const Vertex* vertices, GLuint vertexCount)
+	{
+		AABB bounds = emptyBounds();
+		for (GLuint i = 0; i < vertexCount; i++) {
+			bounds.min = glm::min(bounds.min, vertices[i].Position);
+			bounds.max = glm::max(bounds.max, vertices[i].Position);
+		}
+
+		// the sphere is centered on the box, its radius reaches the furthest vertex
+		BoundingSphere sphere;
+		sphere.center = vertexCount > 0 ? (bounds.min + bounds.max) * 0.5f : glm::vec3(0.0f);
+		float radiusSquared = 0.0f;
+		for (GLuint i = 0; i < vertexCount; i++) {
+			glm::vec3 offset = vertices[i].Position - sphere.center;
+			radiusSquared = glm::max(radiusSquared, glm::dot(offset, offset));
 		}
+		sphere.radius = glm::sqrt(radiusSquared);
 
-		glBindVertexArray(this->buffers.VAO);
-		glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
-
-        for(GLuint i = 0; i < this->textures.size(); i++)
-        {
-            glActiveTexture(GL_TEXTURE0 + i);
-            glBindTexture(GL_TEXTURE_2D, 0);
-        }
-
-    }
-
-	// Initializes all the buffer objects/arrays
-	void Mesh::setupMesh(){
-		// Create buffers/arrays
-		glGenVertexArrays(1, &this->buffers.VAO);
-		glGenBuffers(1, &this->buffers.VBO);
-		glGenBuffers(1, &this->buffers.EBO);
-
-		glBindVertexArray(this->buffers.VAO);
-		// Load data into vertex buffers
-		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
-		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
-
-		// Set the vertex attribute pointers
-		// Vertex Positions
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
-		// Vertex Normals
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
-		// Vertex Texture Coords
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
-
-		glBindVertexArray(0);
+		this->buffers->bounds = bounds;
+		this->buffers->sphere = sphere;
 	}
 }
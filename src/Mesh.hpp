@@ -5,7 +5,11 @@
 #include "glm/glm.hpp"
 
 #include "Shader.hpp"
+#include "GLHandle.hpp"
+#include "Frustum.hpp"
+#include "GeometryArena.hpp"
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -21,9 +25,11 @@ struct Vertex
 
 struct Texture
 {
-    GLuint id;
+    // shared by every mesh using the texture, deleted with the last one
+    std::shared_ptr<TextureHandle> handle;
     //ambientTexture, diffuseTexture, specularTexture
     std::string type;
+    UniformHash typeHash;
     std::string path;
 };
 
@@ -40,25 +46,78 @@ struct Buffers {
     GLuint EBO;
 };
 
+// GPU side of a mesh, shared by every copy of the mesh. The geometry lives in the GeometryArena
+// and is given back with the last copy.
+struct MeshBuffers {
+    GeometryRange geometry;
+    // own vertex array of a mesh with instance attributes, the others use the arena's
+    VertexArrayHandle instanceVAO;
+    // model-space bounds of the vertices
+    AABB bounds;
+    BoundingSphere sphere;
+
+    ~MeshBuffers();
+};
+
+// Copies of a mesh are cheap references to the same buffers and textures
 class Mesh
 {
 public:
-    std::vector<Vertex> vertices;
-    std::vector<GLuint> indices;
     std::vector<Texture> textures;
 
-	Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures);
+	Mesh(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, std::vector<Texture> textures);
+
+	// Uploads the geometry straight from memory, the arrays are not kept by the mesh
+	Mesh(const Vertex* vertices, GLuint vertexCount, const GLuint* indices, GLuint indexCount, std::vector<Texture> textures);
 
 	Buffers getBuffers();
 
-	void Draw(gps::Shader shader);
+	// Model-space bounds, computed when the mesh is uploaded
+	const AABB& getBounds() const;
+	const BoundingSphere& getBoundingSphere() const;
+
+	GLsizei getIndexCount() const;
+
+	// Where the geometry sits in the GeometryArena
+	const GeometryRange& getGeometry() const;
+
+	// drawID is passed as the base instance, it reaches the shader through the draw ID attribute
+	void Draw(gps::Shader& shader, GLuint drawID = 0);
+
+	// Draws instanceCount copies of the mesh, one per entry of the attached instance buffer
+	void DrawInstanced(gps::Shader& shader, GLsizei instanceCount);
+
+	// Binds a buffer of per-instance model matrices to attribute locations 3-6
+	void setupInstanceAttributes(GLuint instanceVBO);
+
+	// Binds a buffer of per-instance particle positions (vec4) to attribute location 7
+	void setupParticleAttribute(GLuint particleVBO);
+
+	// Binds the mesh textures to consecutive texture units, for callers that issue the draw themselves.
+	// They stay bound after the draw.
+	void bindTextures(gps::Shader& shader);
+
+	// Issues only the draw call, the vertex array of getBuffers, the program and the textures have to be bound
+	void drawElements(GLsizei instanceCount, GLuint baseInstance);
 
 private:
     /*  Render data  */
-    Buffers buffers;
+    std::shared_ptr<MeshBuffers> buffers;
+
+	// Copies the geometry into the arena
+	void setupMesh(const Vertex* vertices, GLuint vertexCount, const GLuint* indices, GLuint indexCount);
+
+	// Fits the box and the sphere around the vertices
+	void computeBounds(const Vertex* vertices, GLuint vertexCount);
+
+	// Vertex array the mesh is drawn with
+	GLuint vertexArray() const;
+
+	// Moves the mesh to a vertex array of its own, so it can take instance attributes
+	GLuint instanceVertexArray();
 
-	// Initializes all the buffer objects/arrays
-	void setupMesh();
+	// ambient, diffuse and specular
+	static const GLuint MAX_TEXTURES = 3;
 
 };
 
@@ -0,0 +1,240 @@
+#include "MeshCache.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace gps {
+
+    namespace {
+
+        const char MAGIC[8] = { 'G', 'P', 'S', 'M', 'E', 'S', 'H', '\0' };
+
+        struct FileHeader
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t vertexSize;
+            uint32_t meshCount;
+            uint32_t reserved;
+            uint64_t sourceHash;
+        };
+
+        // Followed by the texture strings, then the vertices and the indices
+        struct MeshHeader
+        {
+            uint32_t vertexCount;
+            uint32_t indexCount;
+            uint32_t textureCount;
+            // size of the texture strings, padded to 4 bytes
+            uint32_t stringBytes;
+        };
+
+        // 64-bit FNV-1a
+        uint64_t hashBytes(const char* data, size_t size, uint64_t hash)
+        {
+            for (size_t i = 0; i < size; i++) {
+                hash ^= (unsigned char)data[i];
+                hash *= 1099511628211ull;
+            }
+            return hash;
+        }
+
+        uint32_t paddedSize(uint32_t size)
+        {
+            return (size + 3) & ~3u;
+        }
+
+        // Sequential reader over the mapped file that fails instead of reading past the end
+        class Reader
+        {
+        public:
+            Reader(const char* data, size_t size) : data(data), size(size), offset(0) {}
+
+            const char* take(size_t bytes)
+            {
+                if (size - offset < bytes)
+                    return NULL;
+                const char* current = data + offset;
+                offset += bytes;
+                return current;
+            }
+
+            bool readString(std::string& value)
+            {
+                const char* length = take(sizeof(uint32_t));
+                if (length == NULL)
+                    return false;
+                uint32_t stringLength;
+                memcpy(&stringLength, length, sizeof(stringLength));
+                const char* chars = take(stringLength);
+                if (chars == NULL)
+                    return false;
+                value.assign(chars, stringLength);
+                return true;
+            }
+
+        private:
+            const char* data;
+            size_t size;
+            size_t offset;
+        };
+
+        void writeString(std::ofstream& out, const std::string& value)
+        {
+            uint32_t length = value.size();
+            out.write((const char*)&length, sizeof(length));
+            out.write(value.data(), length);
+        }
+    }
+
+    std::string MeshCache::CachePath(const std::string& fileName)
+    {
+        return fileName + ".gpsmesh";
+    }
+
+    // Hash of the OBJ contents and of every .mtl library it references
+    uint64_t MeshCache::HashSources(const std::string& fileName, const std::string& basePath)
+    {
+        uint64_t hash = 14695981039346656037ull;
+
+        MappedFile obj;
+        if (!obj.Open(fileName))
+            return hash;
+        hash = hashBytes(obj.Data(), obj.Size(), hash);
+
+        //look for "mtllib <name>" at the start of a line
+        const char* data = obj.Data();
+        size_t size = obj.Size();
+        for (size_t i = 0; i + 7 < size; i++) {
+            if ((i == 0 || data[i - 1] == '\n') && memcmp(data + i, "mtllib", 6) == 0 && (data[i + 6] == ' ' || data[i + 6] == '\t')) {
+                size_t start = i + 7;
+                while (start < size && (data[start] == ' ' || data[start] == '\t'))
+                    start++;
+                size_t end = start;
+                while (end < size && data[end] != '\r' && data[end] != '\n' && data[end] != ' ' && data[end] != '\t')
+                    end++;
+
+                std::string mtlName(data + start, end - start);
+                hash = hashBytes(mtlName.data(), mtlName.size(), hash);
+                MappedFile mtl;
+                if (mtl.Open(basePath + mtlName))
+                    hash = hashBytes(mtl.Data(), mtl.Size(), hash);
+                i = end;
+            }
+        }
+
+        return hash;
+    }
+
+    // Maps the cache of fileName, fails if it is missing, corrupt or out of date
+    bool MeshCache::Open(const std::string& fileName, const std::string& basePath)
+    {
+        meshes.clear();
+        if (!file.Open(CachePath(fileName)))
+            return false;
+
+        Reader reader(file.Data(), file.Size());
+        const char* headerBytes = reader.take(sizeof(FileHeader));
+        if (headerBytes == NULL)
+            return false;
+
+        FileHeader header;
+        memcpy(&header, headerBytes, sizeof(header));
+        if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            header.version != VERSION ||
+            header.vertexSize != sizeof(Vertex) ||
+            header.sourceHash != HashSources(fileName, basePath)) {
+            file.Close();
+            return false;
+        }
+
+        for (uint32_t m = 0; m < header.meshCount; m++) {
+            const char* meshBytes = reader.take(sizeof(MeshHeader));
+            if (meshBytes == NULL) {
+                meshes.clear();
+                file.Close();
+                return false;
+            }
+            MeshHeader meshHeader;
+            memcpy(&meshHeader, meshBytes, sizeof(meshHeader));
+
+            MeshView view;
+            const char* stringData = reader.take(meshHeader.stringBytes);
+            bool valid = stringData != NULL;
+            Reader strings(stringData, valid ? meshHeader.stringBytes : 0);
+            for (uint32_t t = 0; valid && t < meshHeader.textureCount; t++) {
+                TextureInfo texture;
+                valid = strings.readString(texture.type) && strings.readString(texture.path);
+                view.textures.push_back(texture);
+            }
+
+            view.vertexCount = meshHeader.vertexCount;
+            view.vertices = (const Vertex*)reader.take((size_t)meshHeader.vertexCount * sizeof(Vertex));
+            view.indexCount = meshHeader.indexCount;
+            view.indices = (const GLuint*)reader.take((size_t)meshHeader.indexCount * sizeof(GLuint));
+
+            if (!valid || view.vertices == NULL || view.indices == NULL) {
+                std::cerr << "Corrupt mesh cache " << CachePath(fileName) << std::endl;
+                meshes.clear();
+                file.Close();
+                return false;
+            }
+            meshes.push_back(view);
+        }
+
+        return true;
+    }
+
+    const std::vector<MeshCache::MeshView>& MeshCache::Meshes() const
+    {
+        return meshes;
+    }
+
+    // Writes the cache of fileName
+    bool MeshCache::Write(const std::string& fileName, const std::string& basePath, const std::vector<MeshData>& meshes)
+    {
+        std::ofstream out(CachePath(fileName), std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "Could not write mesh cache " << CachePath(fileName) << std::endl;
+            return false;
+        }
+
+        FileHeader header;
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.vertexSize = sizeof(Vertex);
+        header.meshCount = meshes.size();
+        header.reserved = 0;
+        header.sourceHash = HashSources(fileName, basePath);
+        out.write((const char*)&header, sizeof(header));
+
+        for (size_t m = 0; m < meshes.size(); m++) {
+            const MeshData& mesh = meshes[m];
+
+            uint32_t stringBytes = 0;
+            for (size_t t = 0; t < mesh.textures.size(); t++)
+                stringBytes += 2 * sizeof(uint32_t) + mesh.textures[t].type.size() + mesh.textures[t].path.size();
+
+            MeshHeader meshHeader;
+            meshHeader.vertexCount = mesh.vertices.size();
+            meshHeader.indexCount = mesh.indices.size();
+            meshHeader.textureCount = mesh.textures.size();
+            meshHeader.stringBytes = paddedSize(stringBytes);
+            out.write((const char*)&meshHeader, sizeof(meshHeader));
+
+            for (size_t t = 0; t < mesh.textures.size(); t++) {
+                writeString(out, mesh.textures[t].type);
+                writeString(out, mesh.textures[t].path);
+            }
+            //keep the vertex data 4-byte aligned inside the mapping
+            const char padding[4] = { 0, 0, 0, 0 };
+            out.write(padding, meshHeader.stringBytes - stringBytes);
+
+            out.write((const char*)mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+            out.write((const char*)mesh.indices.data(), mesh.indices.size() * sizeof(GLuint));
+        }
+
+        return out.good();
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef MeshCache_hpp
+#define MeshCache_hpp
+
+#include "Mesh.hpp"
+#include "MappedFile.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+// Texture referenced by a mesh, path relative to the model base path
+struct TextureInfo
+{
+    std::string type;
+    std::string path;
+};
+
+// CPU-side geometry of one mesh, as produced by the OBJ reader
+struct MeshData
+{
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    std::vector<TextureInfo> textures;
+};
+
+// Binary sidecar (<model>.obj.gpsmesh) holding the welded meshes of a model,
+// so that the OBJ/MTL text only has to be parsed when it changes
+class MeshCache
+{
+public:
+    // Bump whenever the reader or the file layout changes, old caches are then rebuilt
+    static const uint32_t VERSION = 1;
+
+    // One mesh inside the mapped cache, the pointers stay valid while the cache is open
+    struct MeshView
+    {
+        const Vertex* vertices;
+        GLuint vertexCount;
+        const GLuint* indices;
+        GLuint indexCount;
+        std::vector<TextureInfo> textures;
+    };
+
+    // Maps the cache of fileName, fails if it is missing, corrupt or out of date
+    bool Open(const std::string& fileName, const std::string& basePath);
+    const std::vector<MeshView>& Meshes() const;
+
+    // Writes the cache of fileName
+    static bool Write(const std::string& fileName, const std::string& basePath, const std::vector<MeshData>& meshes);
+
+    static std::string CachePath(const std::string& fileName);
+
+    // Hash of the OBJ contents and of every .mtl library it references
+    static uint64_t HashSources(const std::string& fileName, const std::string& basePath);
+
+private:
+    MappedFile file;
+    std::vector<MeshView> meshes;
+};
+
+}
+
+#endif /* MeshCache_hpp */
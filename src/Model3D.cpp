@@ -1,44 +1,326 @@
 #include "Model3D.hpp"
+#include "RenderStats.hpp"
 
 namespace gps {
 
+	namespace {
+
+		const GLuint EMPTY_SLOT = 0xFFFFFFFFu;
+
+		// Open-addressing (linear probing) map from an OBJ (position, normal, texcoord)
+		// index triple to the index of the welded vertex
+		class VertexWeldMap
+		{
+		public:
+			// The table never grows: it is sized for every corner being a distinct vertex
+			explicit VertexWeldMap(size_t maxKeys)
+			{
+				size_t capacity = 16;
+				while (capacity < maxKeys * 2)
+					capacity <<= 1;
+				mask = capacity - 1;
+				keys.resize(capacity);
+				values.assign(capacity, EMPTY_SLOT);
+			}
+
+			// Returns the vertex index of key, assigning it newIndex if the key was not seen yet
+			GLuint findOrInsert(const tinyobj::index_t& key, GLuint newIndex, bool& inserted)
+			{
+				size_t slot = hash(key) & mask;
+				while (values[slot] != EMPTY_SLOT) {
+					const tinyobj::index_t& current = keys[slot];
+					if (current.vertex_index == key.vertex_index &&
+						current.normal_index == key.normal_index &&
+						current.texcoord_index == key.texcoord_index) {
+						inserted = false;
+						return values[slot];
+					}
+					slot = (slot + 1) & mask;
+				}
+
+				keys[slot] = key;
+				values[slot] = newIndex;
+				inserted = true;
+				return newIndex;
+			}
+
+		private:
+			std::vector<tinyobj::index_t> keys;
+			std::vector<GLuint> values;
+			size_t mask;
+
+			static size_t hash(const tinyobj::index_t& key)
+			{
+				unsigned int h = (unsigned int)key.vertex_index * 73856093u;
+				h ^= (unsigned int)key.normal_index * 19349663u;
+				h ^= (unsigned int)key.texcoord_index * 83492791u;
+				// final avalanche so that neighbouring triples spread over the table
+				h ^= h >> 16;
+				h *= 0x85ebca6bu;
+				h ^= h >> 13;
+				return h;
+			}
+		};
+	}
+
 	void Model3D::LoadModel(std::string fileName)
 	{
-        std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
-		ReadOBJ(fileName, basePath);
+		LoadModel(fileName, GetBasePath(fileName));
 	}
 
     void Model3D::LoadModel(std::string fileName, std::string basePath)
 	{
-		ReadOBJ(fileName, basePath);
+		std::cout << "Loading : " << fileName << std::endl;
+
+		// the cache is mapped and uploaded as is, the OBJ is only parsed when the cache is stale
+		gps::MeshCache cache;
+		if (cache.Open(fileName, basePath)) {
+			const std::vector<gps::MeshCache::MeshView>& views = cache.Meshes();
+			for (size_t i = 0; i < views.size(); i++) {
+				meshes.push_back(gps::Mesh(views[i].vertices, views[i].vertexCount, views[i].indices, views[i].indexCount,
+					LoadTextures(views[i].textures, basePath)));
+			}
+			ComputeBounds();
+			return;
+		}
+
+		std::vector<gps::MeshData> meshData;
+		if (!ReadOBJ(fileName, basePath, meshData)) {
+			exit(1);
+		}
+		gps::MeshCache::Write(fileName, basePath, meshData);
+
+		for (size_t i = 0; i < meshData.size(); i++) {
+			meshes.push_back(gps::Mesh(meshData[i].vertices, meshData[i].indices, LoadTextures(meshData[i].textures, basePath)));
+		}
+		ComputeBounds();
+	}
+
+	// Merges the bounds of the meshes once they are loaded
+	void Model3D::ComputeBounds()
+	{
+		bounds = gps::emptyBounds();
+		for (size_t i = 0; i < meshes.size(); i++)
+			bounds = gps::mergeBounds(bounds, meshes[i].getBounds());
+
+		sphere.center = meshes.empty() ? glm::vec3(0.0f) : (bounds.min + bounds.max) * 0.5f;
+		sphere.radius = meshes.empty() ? 0.0f : glm::length(bounds.max - bounds.min) * 0.5f;
+	}
+
+	const gps::AABB& Model3D::GetBounds() const
+	{
+		return bounds;
+	}
+
+	// Parses the .obj file and (re)writes its binary mesh cache, does not need a GL context
+	bool Model3D::BakeMeshCache(std::string fileName)
+	{
+		std::string basePath = GetBasePath(fileName);
+
+		std::cout << "Baking : " << fileName << std::endl;
+		std::vector<gps::MeshData> meshData;
+		if (!ReadOBJ(fileName, basePath, meshData)) {
+			return false;
+		}
+		return gps::MeshCache::Write(fileName, basePath, meshData);
+	}
+
+	void Model3D::FinishTextureLoads()
+	{
+		GetTextureLoader().Finish();
+	}
+
+	gps::TextureLoader& Model3D::GetTextureLoader()
+	{
+		static gps::TextureLoader loader;
+		return loader;
+	}
+
+	std::string Model3D::GetBasePath(std::string fileName)
+	{
+		return fileName.substr(0, fileName.find_last_of('/')) + "/";
 	}
 
+	std::vector<gps::Texture> Model3D::LoadTextures(const std::vector<gps::TextureInfo>& textures, std::string basePath)
+	{
+		std::vector<gps::Texture> meshTextures;
+		for (size_t i = 0; i < textures.size(); i++) {
+			meshTextures.push_back(LoadTexture(basePath + textures[i].path, textures[i].type));
+		}
+		return meshTextures;
+	}
 
 	// Draw each mesh from the model
-	void Model3D::Draw(gps::Shader shaderProgram)
+	void Model3D::Draw(gps::Shader& shaderProgram)
 	{
 		for (int i = 0; i < meshes.size(); i++)
 			meshes[i].Draw(shaderProgram);
 	}
 
+	// Draws only the meshes whose bounds, placed with modelMatrix, intersect the frustum
+	void Model3D::Draw(gps::Shader& shaderProgram, const gps::Frustum& frustum, const glm::mat4& modelMatrix, GLuint drawID)
+	{
+		for (size_t i = 0; i < meshes.size(); i++) {
+			// the sphere test is cheaper and rejects most of what is off screen
+			if (!frustum.Intersects(gps::transformSphere(meshes[i].getBoundingSphere(), modelMatrix)) ||
+				!frustum.Intersects(gps::transformBounds(meshes[i].getBounds(), modelMatrix))) {
+				RenderStats::Get().Add(RenderStats::CULLED_OBJECTS);
+				continue;
+			}
+			meshes[i].Draw(shaderProgram, drawID);
+		}
+	}
+
+	// Sets the model matrices used by DrawInstanced, one per instance. They are uploaded by the next draw.
+	void Model3D::SetInstanceTransforms(const std::vector<glm::mat4>& transforms)
+	{
+		instanceTransforms = transforms;
+		particleInstances = false;
+		uploadedAllInstances = false;
+	}
+
+	// Fills the instance buffer
+	void Model3D::UploadInstanceTransforms(const std::vector<glm::mat4>& transforms)
+	{
+		if (!instanceBuffer) {
+			instanceBuffer = std::make_shared<gps::BufferHandle>(gps::BufferHandle::create());
+			for (size_t i = 0; i < meshes.size(); i++)
+				meshes[i].setupInstanceAttributes(instanceBuffer->get());
+		}
+
+		instanceCount = transforms.size();
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer->get());
+		glBufferData(GL_ARRAY_BUFFER, transforms.size() * sizeof(glm::mat4), transforms.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		RenderStats::Get().Add(RenderStats::BUFFER_BYTES, transforms.size() * sizeof(glm::mat4));
+	}
+
+	// Uses a GPU-side particle buffer (one vec4 position per instance) for DrawInstanced
+	void Model3D::SetInstanceParticles(GLuint particleVBO, GLsizei particleCount, const gps::AABB& particleVolume)
+	{
+		for (size_t i = 0; i < meshes.size(); i++)
+			meshes[i].setupParticleAttribute(particleVBO);
+
+		instanceCount = particleCount;
+		particleInstances = true;
+		// every particle translates the whole model
+		particleBounds.min = particleVolume.min + bounds.min;
+		particleBounds.max = particleVolume.max + bounds.max;
+	}
+
+	// Draw each mesh from the model once per instance
+	void Model3D::DrawInstanced(gps::Shader& shaderProgram)
+	{
+		// a culled draw may have left only part of the transforms in the buffer
+		if (!particleInstances && !uploadedAllInstances) {
+			UploadInstanceTransforms(instanceTransforms);
+			uploadedAllInstances = true;
+		}
+		if (instanceCount == 0)
+			return;
+
+		for (int i = 0; i < meshes.size(); i++)
+			meshes[i].DrawInstanced(shaderProgram, instanceCount);
+	}
+
+	// Draws the instances whose bounds intersect the frustum
+	void Model3D::DrawInstanced(gps::Shader& shaderProgram, const gps::Frustum& frustum)
+	{
+		GLsizei visibleCount = PrepareInstances(frustum);
+		if (visibleCount == 0)
+			return;
+
+		for (size_t i = 0; i < meshes.size(); i++)
+			meshes[i].DrawInstanced(shaderProgram, visibleCount);
+	}
+
+	// The visible transforms are packed into the instance buffer, the whole set is only uploaded again when needed
+	GLsizei Model3D::PrepareInstances(const gps::Frustum& frustum)
+	{
+		if (particleInstances) {
+			if (frustum.Intersects(particleBounds))
+				return instanceCount;
+			// the particles are culled as one object, counting every droplet would drown the other objects
+			RenderStats::Get().Add(RenderStats::CULLED_OBJECTS);
+			return 0;
+		}
+
+		visibleTransforms.clear();
+		for (size_t i = 0; i < instanceTransforms.size(); i++) {
+			if (frustum.Intersects(gps::transformSphere(sphere, instanceTransforms[i])) &&
+				frustum.Intersects(gps::transformBounds(bounds, instanceTransforms[i])))
+				visibleTransforms.push_back(instanceTransforms[i]);
+		}
+		RenderStats::Get().Add(RenderStats::CULLED_OBJECTS, instanceTransforms.size() - visibleTransforms.size());
+
+		if (visibleTransforms.size() == instanceTransforms.size()) {
+			if (!uploadedAllInstances) {
+				UploadInstanceTransforms(instanceTransforms);
+				uploadedAllInstances = true;
+			}
+			return instanceCount;
+		}
+		if (visibleTransforms.empty())
+			return 0;
+
+		UploadInstanceTransforms(visibleTransforms);
+		uploadedAllInstances = false;
+		return instanceCount;
+	}
+
+	// Queues the meshes that intersect the frustum, sorted by the center of their bounding sphere
+	void Model3D::Submit(gps::RenderQueue& queue, gps::Shader& shaderProgram, const gps::Frustum& frustum,
+		const glm::mat4& modelMatrix, GLuint drawID, unsigned state)
+	{
+		for (size_t i = 0; i < meshes.size(); i++) {
+			gps::BoundingSphere meshSphere = gps::transformSphere(meshes[i].getBoundingSphere(), modelMatrix);
+			if (!frustum.Intersects(meshSphere) ||
+				!frustum.Intersects(gps::transformBounds(meshes[i].getBounds(), modelMatrix))) {
+				RenderStats::Get().Add(RenderStats::CULLED_OBJECTS);
+				continue;
+			}
+			queue.Push(meshes[i], shaderProgram, drawID, 0, state, meshSphere.center);
+		}
+	}
+
+	// Queues the meshes once with the visible instances, sorted by the middle of the instances
+	void Model3D::SubmitInstanced(gps::RenderQueue& queue, gps::Shader& shaderProgram, const gps::Frustum& frustum, unsigned state)
+	{
+		GLsizei visibleCount = PrepareInstances(frustum);
+		if (visibleCount == 0)
+			return;
+
+		glm::vec3 center(0.0f);
+		if (particleInstances) {
+			center = (particleBounds.min + particleBounds.max) * 0.5f;
+		}
+		else {
+			for (size_t i = 0; i < visibleTransforms.size(); i++)
+				center += glm::vec3(visibleTransforms[i][3]);
+			center /= (float)visibleTransforms.size();
+		}
+
+		for (size_t i = 0; i < meshes.size(); i++)
+			queue.Push(meshes[i], shaderProgram, 0, visibleCount, state, center);
+	}
+
 	// Does the parsing of the .obj file and fills in the data structure
-	void Model3D::ReadOBJ(std::string fileName, std::string basePath){
+	bool Model3D::ReadOBJ(std::string fileName, std::string basePath, std::vector<gps::MeshData>& meshData){
 
-        std::cout << "Loading : " << fileName << std::endl;
 		tinyobj::attrib_t attrib;
 		std::vector<tinyobj::shape_t> shapes;
 		std::vector<tinyobj::material_t> materials;
 		int materialId;
 
 		std::string err;
-		bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE);
+		bool ret = gps::ObjParser::Load(&attrib, &shapes, &materials, &err, fileName, basePath, true);
 
 		if (!err.empty()) { // `err` may contain warning message.
 			std::cerr << err << std::endl;
 		}
 
 		if (!ret) {
-			exit(1);
+			return false;
 		}
 
 		std::cout << "# of shapes    : " << shapes.size() << std::endl;
@@ -46,9 +328,14 @@ namespace gps {
 
 		// Loop over shapes
 		for (size_t s = 0; s < shapes.size(); s++) {
-			std::vector<gps::Vertex> vertices;
-			std::vector<GLuint> indices;
-			std::vector<gps::Texture> textures;
+			meshData.push_back(gps::MeshData());
+			std::vector<gps::Vertex>& vertices = meshData.back().vertices;
+			std::vector<GLuint>& indices = meshData.back().indices;
+			std::vector<gps::TextureInfo>& textures = meshData.back().textures;
+
+			// Corners sharing the same (position, normal, texcoord) triple are welded into one vertex
+			VertexWeldMap weldMap(shapes[s].mesh.indices.size());
+			indices.reserve(shapes[s].mesh.indices.size());
 
 			// Loop over faces(polygon)
 			size_t index_offset = 0;
@@ -63,6 +350,12 @@ namespace gps {
 					// access to vertex
 					tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
 
+					bool newVertex;
+					GLuint vertexIndex = weldMap.findOrInsert(idx, vertices.size(), newVertex);
+					indices.push_back(vertexIndex);
+					if (!newVertex)
+						continue;
+
 					float vx = attrib.vertices[3 * idx.vertex_index + 0];
 					float vy = attrib.vertices[3 * idx.vertex_index + 1];
 					float vz = attrib.vertices[3 * idx.vertex_index + 2];
@@ -86,8 +379,6 @@ namespace gps {
 					currentVertex.TexCoords = vertexTexCoords;
 
 					vertices.push_back(currentVertex);
-
-					indices.push_back(index_offset + v);
 				}
 
 				index_offset += fv;
@@ -108,8 +399,9 @@ namespace gps {
 					std::string ambientTexturePath = materials[materialId].ambient_texname;
 					if (!ambientTexturePath.empty())
 					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + ambientTexturePath, "ambientTexture");
+						gps::TextureInfo currentTexture;
+						currentTexture.type = "ambientTexture";
+						currentTexture.path = ambientTexturePath;
 						textures.push_back(currentTexture);
 					}
 
@@ -117,8 +409,9 @@ namespace gps {
 					std::string diffuseTexturePath = materials[materialId].diffuse_texname;
 					if (!diffuseTexturePath.empty())
 					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + diffuseTexturePath, "diffuseTexture");
+						gps::TextureInfo currentTexture;
+						currentTexture.type = "diffuseTexture";
+						currentTexture.path = diffuseTexturePath;
 						textures.push_back(currentTexture);
 					}
 
@@ -126,15 +419,17 @@ namespace gps {
 					std::string specularTexturePath = materials[materialId].specular_texname;
 					if (!specularTexturePath.empty())
 					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + specularTexturePath, "specularTexture");
+						gps::TextureInfo currentTexture;
+						currentTexture.type = "specularTexture";
+						currentTexture.path = specularTexturePath;
 						textures.push_back(currentTexture);
 					}
 				}
 			}
 
-			meshes.push_back(gps::Mesh(vertices, indices, textures));
 		}
+
+		return true;
 	}
 
 	// Retrieves a texture associated with the object - by its name and type
@@ -149,86 +444,13 @@ namespace gps {
 			}
 
 			gps::Texture currentTexture;
-			currentTexture.id = ReadTextureFromFile(path.c_str());
+			currentTexture.handle = GetTextureLoader().Request(path);
 			currentTexture.type = std::string(type);
+			currentTexture.typeHash = uniformHash(type.c_str());
 			currentTexture.path = path;
 
 			loadedTextures.push_back(currentTexture);
 
 			return currentTexture;
 		}
-
-	// Reads the pixel data from an image file and loads it into the video memory
-	GLuint Model3D::ReadTextureFromFile(const char* file_name) {
-		int x, y, n;
-		int force_channels = 4;
-		unsigned char* image_data = stbi_load(file_name, &x, &y, &n, force_channels);
-		if (!image_data) {
-			fprintf(stderr, "ERROR: could not load %s\n", file_name);
-			return false;
-		}
-		// NPOT check
-		if ((x & (x - 1)) != 0 || (y & (y - 1)) != 0) {
-			fprintf(
-				stderr, "WARNING: texture %s is not power-of-2 dimensions\n", file_name
-			);
-		}
-
-		int width_in_bytes = x * 4;
-		unsigned char *top = NULL;
-		unsigned char *bottom = NULL;
-		unsigned char temp = 0;
-		int half_height = y / 2;
-
-		for (int row = 0; row < half_height; row++) {
-			top = image_data + row * width_in_bytes;
-			bottom = image_data + (y - row - 1) * width_in_bytes;
-			for (int col = 0; col < width_in_bytes; col++) {
-				temp = *top;
-				*top = *bottom;
-				*bottom = temp;
-				top++;
-				bottom++;
-			}
-		}
-
-		GLuint textureID;
-		glGenTextures(1, &textureID);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(
-			GL_TEXTURE_2D,
-			0,
-			GL_SRGB8_ALPHA8, //GL_SRGB,//GL_RGBA,
-			x,
-			y,
-			0,
-			GL_RGBA,
-			GL_UNSIGNED_BYTE,
-			image_data
-		);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glBindTexture(GL_TEXTURE_2D, 0);
-
-		return textureID;
-	}
-
-	Model3D::~Model3D() {
-        for (size_t i = 0; i < loadedTextures.size(); i++) {
-            glDeleteTextures(1, &loadedTextures.at(i).id);
-        }
-
-        for (size_t i = 0; i < meshes.size(); i++) {
-            GLuint VBO = meshes.at(i).getBuffers().VBO;
-            GLuint EBO = meshes.at(i).getBuffers().EBO;
-            GLuint VAO = meshes.at(i).getBuffers().VAO;
-            glDeleteBuffers(1, &VBO);
-            glDeleteBuffers(1, &EBO);
-            glDeleteVertexArrays(1, &VAO);
-        }
-	}
 }
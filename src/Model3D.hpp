@@ -2,6 +2,10 @@
 #define Model3D_hpp
 
 #include "Mesh.hpp"
+#include "RenderQueue.hpp"
+#include "MeshCache.hpp"
+#include "ObjParser.hpp"
+#include "TextureLoader.hpp"
 
 #include "tiny_obj_loader.h"
 #include "stb_image.h"
@@ -12,17 +16,51 @@
 
 namespace gps {
 
+    // Copies are lightweight: they share the GPU meshes, textures and instance buffer of the original
     class Model3D
     {
 
     public:
-        ~Model3D();
-
 		void LoadModel(std::string fileName);
 
 		void LoadModel(std::string fileName, std::string basePath);
 
-		void Draw(gps::Shader shaderProgram);
+		// Parses the .obj file and (re)writes its binary mesh cache, does not need a GL context
+		static bool BakeMeshCache(std::string fileName);
+
+		// Waits for the textures requested by LoadModel, they are decoded in the background
+		// and stay empty until this uploads them
+		static void FinishTextureLoads();
+
+		void Draw(gps::Shader& shaderProgram);
+
+		// Draws only the meshes whose bounds, placed with modelMatrix, intersect the frustum.
+		// drawID selects the entry of the transform ring the shader reads the matrices from.
+		void Draw(gps::Shader& shaderProgram, const gps::Frustum& frustum, const glm::mat4& modelMatrix, GLuint drawID = 0);
+
+		// Model-space bounds of all the meshes
+		const gps::AABB& GetBounds() const;
+
+		// Sets the model matrices used by DrawInstanced, one per instance
+		void SetInstanceTransforms(const std::vector<glm::mat4>& transforms);
+
+		// Uses a GPU-side particle buffer (one vec4 position per instance) for DrawInstanced,
+		// particleVolume is the box the positions stay in
+		void SetInstanceParticles(GLuint particleVBO, GLsizei particleCount, const gps::AABB& particleVolume);
+
+		// Draws every mesh once per uploaded instance transform in a single call
+		void DrawInstanced(gps::Shader& shaderProgram);
+
+		// Same, skipping the instances outside the frustum
+		void DrawInstanced(gps::Shader& shaderProgram, const gps::Frustum& frustum);
+
+		// Queues the meshes that intersect the frustum instead of drawing them, state takes RenderQueue::StateFlags
+		void Submit(gps::RenderQueue& queue, gps::Shader& shaderProgram, const gps::Frustum& frustum,
+			const glm::mat4& modelMatrix, GLuint drawID, unsigned state);
+
+		// Queues the meshes once with the instances inside the frustum. The instance buffer is filled
+		// right away, so the queue has to be executed before the next draw of this model.
+		void SubmitInstanced(gps::RenderQueue& queue, gps::Shader& shaderProgram, const gps::Frustum& frustum, unsigned state);
 
 
     private:
@@ -30,15 +68,43 @@ namespace gps {
         std::vector<gps::Mesh> meshes;
 		// Associated textures
         std::vector<gps::Texture> loadedTextures;
+		// Bounds of all the meshes
+		gps::AABB bounds = gps::emptyBounds();
+		gps::BoundingSphere sphere;
+		// Per-instance model matrices
+		std::shared_ptr<gps::BufferHandle> instanceBuffer;
+		GLsizei instanceCount = 0;
+		// CPU copy of the instance transforms, the buffer may hold only the visible ones
+		std::vector<glm::mat4> instanceTransforms;
+		std::vector<glm::mat4> visibleTransforms;
+		bool uploadedAllInstances = false;
+		// World-space bounds of particle instances
+		bool particleInstances = false;
+		gps::AABB particleBounds;
 
 		// Does the parsing of the .obj file and fills in the data structure
-		void ReadOBJ(std::string fileName, std::string basePath);
+		static bool ReadOBJ(std::string fileName, std::string basePath, std::vector<gps::MeshData>& meshData);
+
+		// Directory of the .obj file, used to locate the .mtl file and the textures
+		static std::string GetBasePath(std::string fileName);
+
+		// Merges the bounds of the meshes once they are loaded
+		void ComputeBounds();
+
+		// Fills the instance buffer
+		void UploadInstanceTransforms(const std::vector<glm::mat4>& transforms);
+
+		// Leaves the instances inside the frustum in the instance buffer and returns their number
+		GLsizei PrepareInstances(const gps::Frustum& frustum);
+
+		// Loads the textures of one mesh
+		std::vector<gps::Texture> LoadTextures(const std::vector<gps::TextureInfo>& textures, std::string basePath);
 
 		// Retrieves a texture associated with the object - by its name and type
 		gps::Texture LoadTexture(std::string path, std::string type);
 
-		// Reads the pixel data from an image file and loads it into the video memory
-		GLuint ReadTextureFromFile(const char* file_name);
+		// Decode pool shared by every model
+		static gps::TextureLoader& GetTextureLoader();
     };
 }
 
@@ -0,0 +1,503 @@
+#include "ObjParser.hpp"
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <thread>
+
+namespace gps {
+
+    namespace {
+
+        // Chunks smaller than this are not worth a thread of their own
+        const size_t MIN_CHUNK_BYTES = 256 * 1024;
+
+        // Statement that changes the parser state, recorded at its position in the face stream
+        struct Command
+        {
+            enum Type { GROUP, OBJECT, USEMTL, MTLLIB };
+
+            Type type;
+            std::string name;
+            size_t face;
+            size_t index;
+        };
+
+        // Everything parsed from one line-aligned slice of the file.
+        // Negative (relative) OBJ indices are resolved against the chunk's own counts and
+        // listed in `relative` so they can be shifted once the previous chunks are known.
+        struct Chunk
+        {
+            const char* begin;
+            const char* end;
+
+            std::vector<float> v;
+            std::vector<float> vn;
+            std::vector<float> vt;
+            std::vector<tinyobj::index_t> indices;
+            std::vector<unsigned char> numFaceVertices;
+            std::vector<Command> commands;
+            std::vector<size_t> relative;
+
+            size_t vBase;
+            size_t vnBase;
+            size_t vtBase;
+        };
+
+        // Run of consecutive faces of one chunk that end up in the same shape with the same material
+        struct Segment
+        {
+            size_t chunk;
+            size_t shape;
+            int material;
+            size_t faceBegin;
+            size_t faceEnd;
+            size_t indexBegin;
+            size_t indexEnd;
+            size_t faceDest;
+            size_t indexDest;
+        };
+
+        inline bool isSpace(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\r';
+        }
+
+        inline void skipSpace(const char*& p, const char* end)
+        {
+            while (p < end && isSpace(*p))
+                p++;
+        }
+
+        inline void skipToken(const char*& p, const char* end)
+        {
+            while (p < end && !isSpace(*p))
+                p++;
+        }
+
+        std::string parseName(const char*& p, const char* end)
+        {
+            skipSpace(p, end);
+            const char* start = p;
+            skipToken(p, end);
+            return std::string(start, p);
+        }
+
+        // atoi over [p, end), stops at the first non-digit
+        inline int parseInt(const char*& p, const char* end)
+        {
+            bool negative = false;
+            if (p < end && (*p == '-' || *p == '+')) {
+                negative = *p == '-';
+                p++;
+            }
+            int value = 0;
+            while (p < end && *p >= '0' && *p <= '9') {
+                value = value * 10 + (*p - '0');
+                p++;
+            }
+            return negative ? -value : value;
+        }
+
+        // Decimal float with optional exponent. Malformed tokens read as 0 like in tinyobj.
+        float parseFloat(const char*& p, const char* end)
+        {
+            static const double POWERS[] = {
+                1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+            };
+
+            skipSpace(p, end);
+            const char* start = p;
+
+            bool negative = false;
+            if (p < end && (*p == '-' || *p == '+')) {
+                negative = *p == '-';
+                p++;
+            }
+
+            uint64_t mantissa = 0;
+            int exponent = 0;
+            int digits = 0;
+            while (p < end && *p >= '0' && *p <= '9') {
+                if (mantissa < 100000000000000000ull)
+                    mantissa = mantissa * 10 + (*p - '0');
+                else
+                    exponent++;
+                digits++;
+                p++;
+            }
+            if (p < end && *p == '.') {
+                p++;
+                while (p < end && *p >= '0' && *p <= '9') {
+                    if (mantissa < 100000000000000000ull) {
+                        mantissa = mantissa * 10 + (*p - '0');
+                        exponent--;
+                    }
+                    digits++;
+                    p++;
+                }
+            }
+            if (digits == 0) {
+                p = start;
+                skipToken(p, end);
+                return 0.0f;
+            }
+            if (p < end && (*p == 'e' || *p == 'E')) {
+                p++;
+                exponent += parseInt(p, end);
+            }
+            if (p < end && !isSpace(*p)) {
+                p = start;
+                skipToken(p, end);
+                return 0.0f;
+            }
+
+            double value = (double)mantissa;
+            if (exponent < 0 && exponent >= -22)
+                value /= POWERS[-exponent];
+            else if (exponent > 0 && exponent <= 22)
+                value *= POWERS[exponent];
+            else if (exponent != 0)
+                value *= std::pow(10.0, exponent);
+
+            return (float)(negative ? -value : value);
+        }
+
+        // Turns an OBJ index into a 0-based one; relative indices are resolved against the chunk counts
+        inline int fixIndex(int index, size_t count, bool& relative)
+        {
+            relative = index < 0;
+            if (index > 0)
+                return index - 1;
+            if (index == 0)
+                return 0;
+            return (int)count + index;
+        }
+
+        // One corner of a face: v, v/vt, v//vn or v/vt/vn
+        tinyobj::index_t parseCorner(const char*& p, const char* end, Chunk& chunk, size_t corner)
+        {
+            tinyobj::index_t index;
+            index.vertex_index = -1;
+            index.normal_index = -1;
+            index.texcoord_index = -1;
+
+            bool relative;
+            index.vertex_index = fixIndex(parseInt(p, end), chunk.v.size() / 3, relative);
+            if (relative)
+                chunk.relative.push_back(corner * 3 + 0);
+            if (p >= end || *p != '/')
+                return index;
+            p++;
+
+            if (p < end && *p != '/') {
+                index.texcoord_index = fixIndex(parseInt(p, end), chunk.vt.size() / 2, relative);
+                if (relative)
+                    chunk.relative.push_back(corner * 3 + 2);
+            }
+            if (p >= end || *p != '/')
+                return index;
+            p++;
+
+            index.normal_index = fixIndex(parseInt(p, end), chunk.vn.size() / 3, relative);
+            if (relative)
+                chunk.relative.push_back(corner * 3 + 1);
+            return index;
+        }
+
+        inline bool startsWith(const char* p, const char* end, const char* keyword, size_t length)
+        {
+            return (size_t)(end - p) > length && memcmp(p, keyword, length) == 0 && isSpace(p[length]);
+        }
+
+        void addCommand(Chunk& chunk, Command::Type type, const std::string& name)
+        {
+            Command command;
+            command.type = type;
+            command.name = name;
+            command.face = chunk.numFaceVertices.size();
+            command.index = chunk.indices.size();
+            chunk.commands.push_back(command);
+        }
+
+        void parseChunk(Chunk& chunk, bool triangulate)
+        {
+            std::vector<tinyobj::index_t> face;
+            std::vector<size_t> faceRelative;
+
+            const char* line = chunk.begin;
+            while (line < chunk.end) {
+                const char* lineEnd = (const char*)memchr(line, '\n', chunk.end - line);
+                if (lineEnd == NULL)
+                    lineEnd = chunk.end;
+                const char* p = line;
+                line = lineEnd + 1;
+
+                skipSpace(p, lineEnd);
+                if (p == lineEnd || *p == '#')
+                    continue;
+
+                if (startsWith(p, lineEnd, "v", 1)) {
+                    p += 2;
+                    chunk.v.push_back(parseFloat(p, lineEnd));
+                    chunk.v.push_back(parseFloat(p, lineEnd));
+                    chunk.v.push_back(parseFloat(p, lineEnd));
+                }
+                else if (startsWith(p, lineEnd, "vn", 2)) {
+                    p += 3;
+                    chunk.vn.push_back(parseFloat(p, lineEnd));
+                    chunk.vn.push_back(parseFloat(p, lineEnd));
+                    chunk.vn.push_back(parseFloat(p, lineEnd));
+                }
+                else if (startsWith(p, lineEnd, "vt", 2)) {
+                    p += 3;
+                    chunk.vt.push_back(parseFloat(p, lineEnd));
+                    chunk.vt.push_back(parseFloat(p, lineEnd));
+                }
+                else if (startsWith(p, lineEnd, "f", 1)) {
+                    p += 2;
+                    face.clear();
+                    size_t relativeStart = chunk.relative.size();
+                    skipSpace(p, lineEnd);
+                    while (p < lineEnd) {
+                        face.push_back(parseCorner(p, lineEnd, chunk, face.size()));
+                        skipToken(p, lineEnd);
+                        skipSpace(p, lineEnd);
+                    }
+
+                    // corner positions were recorded relative to the face, rebase them on the output
+                    faceRelative.assign(chunk.relative.begin() + relativeStart, chunk.relative.end());
+                    chunk.relative.resize(relativeStart);
+
+                    size_t base = chunk.indices.size();
+                    if (triangulate) {
+                        if (face.size() < 3)
+                            continue;
+                        // Polygon -> triangle fan conversion
+                        for (size_t k = 2; k < face.size(); k++) {
+                            size_t corners[3] = { 0, k - 1, k };
+                            for (int c = 0; c < 3; c++) {
+                                chunk.indices.push_back(face[corners[c]]);
+                                for (size_t r = 0; r < faceRelative.size(); r++)
+                                    if (faceRelative[r] / 3 == corners[c])
+                                        chunk.relative.push_back((base + c) * 3 + faceRelative[r] % 3);
+                            }
+                            chunk.numFaceVertices.push_back(3);
+                            base += 3;
+                        }
+                    }
+                    else {
+                        if (face.empty())
+                            continue;
+                        chunk.indices.insert(chunk.indices.end(), face.begin(), face.end());
+                        for (size_t r = 0; r < faceRelative.size(); r++)
+                            chunk.relative.push_back(base * 3 + faceRelative[r]);
+                        chunk.numFaceVertices.push_back((unsigned char)face.size());
+                    }
+                }
+                else if (startsWith(p, lineEnd, "usemtl", 6)) {
+                    p += 7;
+                    addCommand(chunk, Command::USEMTL, parseName(p, lineEnd));
+                }
+                else if (startsWith(p, lineEnd, "mtllib", 6)) {
+                    p += 7;
+                    addCommand(chunk, Command::MTLLIB, parseName(p, lineEnd));
+                }
+                else if (startsWith(p, lineEnd, "g", 1)) {
+                    p += 2;
+                    addCommand(chunk, Command::GROUP, parseName(p, lineEnd));
+                }
+                else if (startsWith(p, lineEnd, "o", 1)) {
+                    p += 2;
+                    addCommand(chunk, Command::OBJECT, parseName(p, lineEnd));
+                }
+                // Ignore unknown command.
+            }
+        }
+
+        // Appends a shape sized for its faces, filled in later by scatterChunk
+        void addShape(std::vector<tinyobj::shape_t>* shapes, const std::string& name, size_t faceCount, size_t indexCount)
+        {
+            shapes->push_back(tinyobj::shape_t());
+            shapes->back().name = name;
+            shapes->back().mesh.indices.resize(indexCount);
+            shapes->back().mesh.num_face_vertices.resize(faceCount);
+            shapes->back().mesh.material_ids.resize(faceCount);
+        }
+
+        // Copies the chunk's attributes and faces to their final place in the output
+        void scatterChunk(Chunk& chunk, size_t chunkIndex, const std::vector<Segment>& segments,
+                          tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes)
+        {
+            for (size_t r = 0; r < chunk.relative.size(); r++) {
+                tinyobj::index_t& index = chunk.indices[chunk.relative[r] / 3];
+                switch (chunk.relative[r] % 3) {
+                case 0: index.vertex_index += (int)(chunk.vBase / 3); break;
+                case 1: index.normal_index += (int)(chunk.vnBase / 3); break;
+                default: index.texcoord_index += (int)(chunk.vtBase / 2); break;
+                }
+            }
+
+            std::copy(chunk.v.begin(), chunk.v.end(), attrib->vertices.begin() + chunk.vBase);
+            std::copy(chunk.vn.begin(), chunk.vn.end(), attrib->normals.begin() + chunk.vnBase);
+            std::copy(chunk.vt.begin(), chunk.vt.end(), attrib->texcoords.begin() + chunk.vtBase);
+
+            for (size_t s = 0; s < segments.size(); s++) {
+                const Segment& segment = segments[s];
+                if (segment.chunk != chunkIndex)
+                    continue;
+                tinyobj::mesh_t& mesh = (*shapes)[segment.shape].mesh;
+                std::copy(chunk.indices.begin() + segment.indexBegin, chunk.indices.begin() + segment.indexEnd,
+                          mesh.indices.begin() + segment.indexDest);
+                std::copy(chunk.numFaceVertices.begin() + segment.faceBegin, chunk.numFaceVertices.begin() + segment.faceEnd,
+                          mesh.num_face_vertices.begin() + segment.faceDest);
+                std::fill(mesh.material_ids.begin() + segment.faceDest,
+                          mesh.material_ids.begin() + segment.faceDest + (segment.faceEnd - segment.faceBegin),
+                          segment.material);
+            }
+        }
+    }
+
+    bool ObjParser::Load(tinyobj::attrib_t* attrib,
+                         std::vector<tinyobj::shape_t>* shapes,
+                         std::vector<tinyobj::material_t>* materials,
+                         std::string* err,
+                         const std::string& fileName,
+                         const std::string& basePath,
+                         bool triangulate)
+    {
+        attrib->vertices.clear();
+        attrib->normals.clear();
+        attrib->texcoords.clear();
+        shapes->clear();
+
+        MappedFile file;
+        if (!file.Open(fileName)) {
+            if (err)
+                (*err) = "Cannot open file [" + fileName + "]\n";
+            return false;
+        }
+
+        // Split the file into line-aligned chunks, one per thread
+        size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+        size_t chunkCount = std::max<size_t>(1, std::min(threadCount, file.Size() / MIN_CHUNK_BYTES));
+
+        const char* data = file.Data();
+        const char* dataEnd = data + file.Size();
+        std::vector<Chunk> chunks(chunkCount);
+        const char* begin = data;
+        for (size_t c = 0; c < chunkCount; c++) {
+            const char* end = dataEnd;
+            if (c + 1 < chunkCount) {
+                end = data + file.Size() * (c + 1) / chunkCount;
+                if (end < begin)
+                    end = begin;
+                const char* newline = (const char*)memchr(end, '\n', dataEnd - end);
+                end = newline != NULL ? newline + 1 : dataEnd;
+            }
+            chunks[c].begin = begin;
+            chunks[c].end = end;
+            begin = end;
+        }
+
+        std::vector<std::thread> workers;
+        for (size_t c = 1; c < chunkCount; c++)
+            workers.push_back(std::thread(parseChunk, std::ref(chunks[c]), triangulate));
+        parseChunk(chunks[0], triangulate);
+        for (size_t w = 0; w < workers.size(); w++)
+            workers[w].join();
+        workers.clear();
+
+        // Replay the state changes in file order to assign every run of faces to a shape and a material.
+        // Unlike tinyobj, faces exported by a `usemtl` right before a `g`/`o` line are kept.
+        tinyobj::MaterialFileReader materialReader(basePath);
+        std::map<std::string, int> materialMap;
+        int material = -1;
+        std::string name;
+        std::vector<Segment> segments;
+        size_t shapeFaces = 0;
+        size_t shapeIndices = 0;
+        size_t vertexCount = 0;
+        size_t normalCount = 0;
+        size_t texcoordCount = 0;
+
+        for (size_t c = 0; c < chunkCount; c++) {
+            Chunk& chunk = chunks[c];
+            chunk.vBase = vertexCount;
+            chunk.vnBase = normalCount;
+            chunk.vtBase = texcoordCount;
+            vertexCount += chunk.v.size();
+            normalCount += chunk.vn.size();
+            texcoordCount += chunk.vt.size();
+
+            size_t face = 0;
+            size_t index = 0;
+            for (size_t i = 0; i <= chunk.commands.size(); i++) {
+                bool last = i == chunk.commands.size();
+                size_t nextFace = last ? chunk.numFaceVertices.size() : chunk.commands[i].face;
+                size_t nextIndex = last ? chunk.indices.size() : chunk.commands[i].index;
+
+                if (nextFace > face) {
+                    Segment segment;
+                    segment.chunk = c;
+                    segment.shape = shapes->size();
+                    segment.material = material;
+                    segment.faceBegin = face;
+                    segment.faceEnd = nextFace;
+                    segment.indexBegin = index;
+                    segment.indexEnd = nextIndex;
+                    segment.faceDest = shapeFaces;
+                    segment.indexDest = shapeIndices;
+                    segments.push_back(segment);
+                    shapeFaces += nextFace - face;
+                    shapeIndices += nextIndex - index;
+                }
+                face = nextFace;
+                index = nextIndex;
+                if (last)
+                    break;
+
+                const Command& command = chunk.commands[i];
+                if (command.type == Command::GROUP || command.type == Command::OBJECT) {
+                    // flush the current shape
+                    if (shapeFaces > 0)
+                        addShape(shapes, name, shapeFaces, shapeIndices);
+                    shapeFaces = 0;
+                    shapeIndices = 0;
+                    name = command.name;
+                }
+                else if (command.type == Command::USEMTL) {
+                    std::map<std::string, int>::const_iterator it = materialMap.find(command.name);
+                    material = it != materialMap.end() ? it->second : -1;
+                }
+                else {
+                    std::string mtlErr;
+                    bool ok = materialReader(command.name, materials, &materialMap, &mtlErr);
+                    if (err)
+                        (*err) += mtlErr;
+                    if (!ok)
+                        return false;
+                }
+            }
+        }
+        if (shapeFaces > 0)
+            addShape(shapes, name, shapeFaces, shapeIndices);
+
+        attrib->vertices.resize(vertexCount);
+        attrib->normals.resize(normalCount);
+        attrib->texcoords.resize(texcoordCount);
+
+        // Fix relative indices and move everything into place, again one chunk per thread
+        for (size_t c = 1; c < chunkCount; c++)
+            workers.push_back(std::thread(scatterChunk, std::ref(chunks[c]), c, std::cref(segments), attrib, shapes));
+        scatterChunk(chunks[0], 0, segments, attrib, shapes);
+        for (size_t w = 0; w < workers.size(); w++)
+            workers[w].join();
+
+        return true;
+    }
+}
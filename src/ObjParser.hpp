@@ -0,0 +1,28 @@
+#ifndef ObjParser_hpp
+#define ObjParser_hpp
+
+#include "tiny_obj_loader.h"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Multithreaded replacement for tinyobj::LoadObj.
+    // The file is memory mapped and split into line-aligned chunks that are parsed on
+    // separate threads, then stitched back into the same attrib/shapes/materials layout
+    // tinyobj produces. Materials are still read through tinyobj::MaterialFileReader.
+    class ObjParser
+    {
+    public:
+        static bool Load(tinyobj::attrib_t* attrib,
+                         std::vector<tinyobj::shape_t>* shapes,
+                         std::vector<tinyobj::material_t>* materials,
+                         std::string* err,
+                         const std::string& fileName,
+                         const std::string& basePath,
+                         bool triangulate = true);
+    };
+}
+
+#endif /* ObjParser_hpp */
@@ -0,0 +1,104 @@
+#include "RainSystem.hpp"
+#include "GLStateCache.hpp"
+#include "RenderStats.hpp"
+
+#include <random>
+
+namespace gps {
+
+    //uniform names
+    constexpr UniformHash rainMinUniform = uniformHash("rainMin");
+    constexpr UniformHash rainMaxUniform = uniformHash("rainMax");
+    constexpr UniformHash speedRangeUniform = uniformHash("speedRange");
+    constexpr UniformHash seedUniform = uniformHash("seed");
+
+    // Spawns particleCount droplets inside the [volumeMin, volumeMax] box
+    void RainSystem::Init(GLuint particleCount, glm::vec3 volumeMin, glm::vec3 volumeMax, float minSpeed, float maxSpeed, unsigned seed)
+    {
+        this->particleCount = particleCount;
+        this->volumeMin = volumeMin;
+        this->volumeMax = volumeMax;
+        this->minSpeed = minSpeed;
+        this->maxSpeed = maxSpeed;
+
+        std::mt19937 gen(seed);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+        initialParticles.resize(particleCount);
+        for (GLuint i = 0; i < particleCount; i++) {
+            glm::vec3 position;
+            position.x = glm::mix(volumeMin.x, volumeMax.x, unit(gen));
+            position.y = glm::mix(volumeMin.y, volumeMax.y, unit(gen));
+            position.z = glm::mix(volumeMin.z, volumeMax.z, unit(gen));
+            initialParticles[i] = glm::vec4(position, glm::mix(minSpeed, maxSpeed, unit(gen)));
+        }
+
+        for (int i = 0; i < 2; i++) {
+            particleVAO[i] = gps::VertexArrayHandle::create();
+            particleVBO[i] = gps::BufferHandle::create();
+            GLStateCache::Get().BindVertexArray(particleVAO[i].get());
+            glBindBuffer(GL_ARRAY_BUFFER, particleVBO[i].get());
+            glBufferData(GL_ARRAY_BUFFER, particleCount * sizeof(glm::vec4), initialParticles.data(), GL_DYNAMIC_COPY);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (GLvoid*)0);
+        }
+        GLStateCache::Get().BindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        current = 0;
+    }
+
+    // Moves every droplet down by its speed, respawning the ones that reached the ground
+    void RainSystem::Update(gps::Shader& updateShader)
+    {
+        int next = 1 - current;
+
+        updateShader.useShaderProgram();
+        updateShader.setVec3(rainMinUniform, volumeMin);
+        updateShader.setVec3(rainMaxUniform, volumeMax);
+        updateShader.setVec2(speedRangeUniform, glm::vec2(minSpeed, maxSpeed));
+        updateShader.setUint(seedUniform, tick++);
+
+        //read the current state, capture the advanced state into the other buffer
+        glEnable(GL_RASTERIZER_DISCARD);
+        GLStateCache::Get().BindVertexArray(particleVAO[current].get());
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, particleVBO[next].get());
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, particleCount);
+        RenderStats::Get().Add(RenderStats::DRAW_CALLS);
+        RenderStats::Get().Add(RenderStats::VERTICES, particleCount);
+        glEndTransformFeedback();
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        GLStateCache::Get().BindVertexArray(0);
+        glDisable(GL_RASTERIZER_DISCARD);
+
+        current = next;
+    }
+
+    // Puts every droplet back in its initial position
+    void RainSystem::Reset()
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, particleVBO[current].get());
+        glBufferSubData(GL_ARRAY_BUFFER, 0, particleCount * sizeof(glm::vec4), initialParticles.data());
+        RenderStats::Get().Add(RenderStats::BUFFER_BYTES, particleCount * sizeof(glm::vec4));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    GLuint RainSystem::GetParticleBuffer()
+    {
+        return particleVBO[current].get();
+    }
+
+    GLuint RainSystem::GetParticleCount()
+    {
+        return particleCount;
+    }
+
+    // Box every droplet stays in, including the overshoot below the ground before respawning
+    gps::AABB RainSystem::GetBounds()
+    {
+        gps::AABB bounds;
+        bounds.min = glm::vec3(volumeMin.x, -maxSpeed, volumeMin.z);
+        bounds.max = volumeMax;
+        return bounds;
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef RainSystem_hpp
+#define RainSystem_hpp
+
+#include "Shader.hpp"
+#include "GLHandle.hpp"
+#include "Frustum.hpp"
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Rain droplets simulated on the GPU: every particle is a vec4 (xyz position, w fall speed)
+    // and the state is advanced between two buffers with transform feedback
+    class RainSystem
+    {
+    public:
+        // Spawns particleCount droplets inside the [volumeMin, volumeMax] box, the same seed gives the same rain
+        void Init(GLuint particleCount, glm::vec3 volumeMin, glm::vec3 volumeMax, float minSpeed, float maxSpeed, unsigned seed);
+
+        // Moves every droplet down by its speed, respawning the ones that reached the ground
+        void Update(gps::Shader& updateShader);
+
+        // Puts every droplet back in its initial position
+        void Reset();
+
+        // Buffer holding the current particle state, usable as an instance attribute
+        GLuint GetParticleBuffer();
+        GLuint GetParticleCount();
+
+        // Box every droplet stays in, including the overshoot below the ground before respawning
+        gps::AABB GetBounds();
+
+    private:
+        gps::VertexArrayHandle particleVAO[2];
+        gps::BufferHandle particleVBO[2];
+        // index of the buffer holding the current state
+        int current = 0;
+        GLuint particleCount = 0;
+        GLuint tick = 0;
+
+        glm::vec3 volumeMin;
+        glm::vec3 volumeMax;
+        float minSpeed;
+        float maxSpeed;
+        std::vector<glm::vec4> initialParticles;
+    };
+}
+
+#endif /* RainSystem_hpp */
@@ -0,0 +1,217 @@
+#include "RenderQueue.hpp"
+#include "CpuProfiler.hpp"
+#include "GLStateCache.hpp"
+#include "RenderStats.hpp"
+
+#include <algorithm>
+
+namespace gps {
+
+    namespace {
+
+        // Key fields, widths in bits
+        const int PASS_BITS = 4;
+        const int PROGRAM_BITS = 10;
+        const int STATE_BITS = 2;
+        const int MATERIAL_BITS = 16;
+        const int DEPTH_BITS = 24;
+
+        uint64_t field(uint64_t value, int bits)
+        {
+            return value & ((1ull << bits) - 1);
+        }
+    }
+
+    // Starts collecting the draws of a pass, viewProjection places them for the depth sort.
+    // A pass that samples no textures leaves them out of the sort and the batches.
+    void RenderQueue::Begin(unsigned pass, const glm::mat4& viewProjection, bool useTextures)
+    {
+        this->pass = pass;
+        this->viewProjection = viewProjection;
+        this->useTextures = useTextures;
+        items.clear();
+        keys.clear();
+    }
+
+    void RenderQueue::Push(Mesh& mesh, Shader& shader, GLuint drawID, GLsizei instanceCount, unsigned state, const glm::vec3& center)
+    {
+        Item item;
+        item.mesh = &mesh;
+        item.shader = &shader;
+        item.drawID = drawID;
+        item.instanceCount = instanceCount;
+        item.state = state;
+        items.push_back(item);
+        keys.push_back(MakeKey(item, center));
+    }
+
+    uint64_t RenderQueue::MakeKey(const Item& item, const glm::vec3& center) const
+    {
+        //window depth of the center, what is behind the eye goes first
+        glm::vec4 clip = viewProjection * glm::vec4(center, 1.0f);
+        float depth = clip.w > 0.0f ? clip.z / clip.w * 0.5f + 0.5f : 0.0f;
+        depth = std::min(std::max(depth, 0.0f), 1.0f);
+        uint64_t depthBits = (uint64_t)(depth * ((1u << DEPTH_BITS) - 1));
+
+        //the program and material only group the draws, collisions cost a state change, not a wrong draw
+        uint64_t program = field(item.shader->shaderProgram, PROGRAM_BITS);
+        uint64_t material = !useTextures || item.mesh->textures.empty() ? 0 : field(item.mesh->textures[0].handle->get(), MATERIAL_BITS);
+        uint64_t state = field(item.state & DOUBLE_SIDED, STATE_BITS);
+        bool translucent = (item.state & TRANSLUCENT) != 0;
+
+        uint64_t key = field(pass, PASS_BITS);
+        key = (key << 1) | (translucent ? 1 : 0);
+        if (translucent) {
+            key = (key << DEPTH_BITS) | (field(~depthBits, DEPTH_BITS));
+            key = (key << PROGRAM_BITS) | program;
+            key = (key << STATE_BITS) | state;
+            key = (key << MATERIAL_BITS) | material;
+        }
+        else {
+            key = (key << PROGRAM_BITS) | program;
+            key = (key << STATE_BITS) | state;
+            key = (key << MATERIAL_BITS) | material;
+            key = (key << DEPTH_BITS) | depthBits;
+        }
+        //the used fields start at the top bit
+        return key << (64 - PASS_BITS - 1 - DEPTH_BITS - PROGRAM_BITS - STATE_BITS - MATERIAL_BITS);
+    }
+
+    // LSD radix sort of the item indices by key, one byte per round
+    void RenderQueue::Sort()
+    {
+        GPS_PROFILE_SCOPE("RenderQueue::Sort");
+        size_t count = items.size();
+        order.resize(count);
+        scratch.resize(count);
+        for (size_t i = 0; i < count; i++)
+            order[i] = (uint32_t)i;
+        if (count < 2)
+            return;
+
+        for (int shift = 0; shift < 64; shift += 8) {
+            size_t offsets[257] = { 0 };
+            for (size_t i = 0; i < count; i++)
+                offsets[((keys[order[i]] >> shift) & 0xFF) + 1]++;
+
+            //a byte shared by every key leaves the order as it is
+            if (offsets[((keys[order[0]] >> shift) & 0xFF) + 1] == count)
+                continue;
+
+            for (int digit = 0; digit < 256; digit++)
+                offsets[digit + 1] += offsets[digit];
+            for (size_t i = 0; i < count; i++)
+                scratch[offsets[(keys[order[i]] >> shift) & 0xFF]++] = order[i];
+            order.swap(scratch);
+        }
+    }
+
+    // Builds the commands and splits them into batches, returns the triangles they draw
+    size_t RenderQueue::BuildBatches()
+    {
+        commands.resize(order.size());
+        batches.clear();
+        size_t triangleCount = 0;
+
+        for (size_t i = 0; i < order.size(); i++) {
+            const Item& item = items[order[i]];
+            const GeometryRange& geometry = item.mesh->getGeometry();
+
+            //the base instance carries the draw ID, instanced draws read their own attributes from 0
+            DrawElementsIndirectCommand& command = commands[i];
+            command.count = geometry.indexCount;
+            command.instanceCount = item.instanceCount > 0 ? item.instanceCount : 1;
+            command.firstIndex = geometry.firstIndex;
+            command.baseVertex = geometry.baseVertex;
+            command.baseInstance = item.drawID;
+            triangleCount += (size_t)command.count / 3 * command.instanceCount;
+
+            if (batches.empty() || !SameBatch(items[batches.back().item], item)) {
+                Batch batch;
+                batch.item = order[i];
+                batch.first = (GLuint)i;
+                batch.count = 0;
+                batches.push_back(batch);
+            }
+            batches.back().count++;
+        }
+        return triangleCount;
+    }
+
+    // Whether the second item can join the multi-draw of the first
+    bool RenderQueue::SameBatch(const Item& a, const Item& b) const
+    {
+        if (a.shader != b.shader || a.state != b.state)
+            return false;
+        if (a.mesh->getBuffers().VAO != b.mesh->getBuffers().VAO)
+            return false;
+        return !useTextures || SameTextures(*a.mesh, *b.mesh);
+    }
+
+    // Sorts and submits the collected draws, culling is left on and blending off afterwards
+    void RenderQueue::Execute()
+    {
+        GPS_PROFILE_SCOPE("RenderQueue::Execute");
+        Sort();
+        size_t triangleCount = BuildBatches();
+        if (commands.empty())
+            return;
+
+        //every command of the pass goes up in one write
+        if (!indirectBuffer)
+            indirectBuffer = gps::BufferHandle::create();
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer.get());
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+
+        RenderStats& stats = RenderStats::Get();
+        stats.Add(RenderStats::BUFFER_BYTES, commands.size() * sizeof(DrawElementsIndirectCommand));
+        stats.Add(RenderStats::DRAW_CALLS, batches.size());
+        stats.Add(RenderStats::TRIANGLES, triangleCount);
+        stats.Add(RenderStats::VERTICES, triangleCount * 3);
+
+        //the state cache drops the calls that set what is already current
+        GLStateCache& state = GLStateCache::Get();
+        Shader* currentShader = NULL;
+        Mesh* texturedMesh = NULL;
+
+        for (size_t i = 0; i < batches.size(); i++) {
+            const Batch& batch = batches[i];
+            const Item& item = items[batch.item];
+
+            //the sampler uniforms belong to the program, a new program rebinds the textures as well
+            if (item.shader != currentShader) {
+                item.shader->useShaderProgram();
+                currentShader = item.shader;
+                texturedMesh = NULL;
+            }
+
+            if (useTextures && (texturedMesh == NULL || !SameTextures(*texturedMesh, *item.mesh))) {
+                item.mesh->bindTextures(*item.shader);
+                texturedMesh = item.mesh;
+            }
+
+            state.SetCullFace((item.state & DOUBLE_SIDED) == 0);
+            state.SetBlend((item.state & TRANSLUCENT) != 0);
+            state.BindVertexArray(item.mesh->getBuffers().VAO);
+
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                        (GLvoid*)(batch.first * sizeof(DrawElementsIndirectCommand)), batch.count, 0);
+        }
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        state.SetCullFace(true);
+        state.SetBlend(false);
+    }
+
+    bool RenderQueue::SameTextures(const Mesh& a, const Mesh& b)
+    {
+        if (a.textures.size() != b.textures.size())
+            return false;
+        for (size_t i = 0; i < a.textures.size(); i++) {
+            if (a.textures[i].handle->get() != b.textures[i].handle->get() ||
+                a.textures[i].typeHash != b.textures[i].typeHash)
+                return false;
+        }
+        return true;
+    }
+}
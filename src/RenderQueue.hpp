@@ -0,0 +1,101 @@
+#ifndef RenderQueue_hpp
+#define RenderQueue_hpp
+
+#include "GLHandle.hpp"
+#include "Mesh.hpp"
+#include "Shader.hpp"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // Draws of a pass collected first and submitted in the order of a packed 64-bit key, so
+    // neighbouring draws share their program, textures and raster state and those are only set
+    // when they change. From the most significant bits down the key holds the pass, translucency,
+    // then for opaque draws program, raster state, material and depth (front to back, for early-z)
+    // and for translucent draws the inverted depth first (back to front) and the rest after it.
+    // The sorted draws become indirect commands, and every run of draws sharing the program, textures,
+    // raster state and vertex array is submitted with a single glMultiDrawElementsIndirect.
+    class RenderQueue
+    {
+    public:
+        // Raster state of an item, everything else is drawn with back face culling and no blending
+        enum StateFlags
+        {
+            DOUBLE_SIDED = 1 << 0,
+            TRANSLUCENT = 1 << 1
+        };
+
+        // Starts collecting the draws of a pass, viewProjection places them for the depth sort.
+        // A pass that samples no textures leaves them out of the sort and the batches.
+        void Begin(unsigned pass, const glm::mat4& viewProjection, bool useTextures = true);
+
+        // Adds a draw of the mesh. Instanced draws pass the number of instances and a drawID of 0, as the
+        // base instance would offset their instance attributes. center is the world-space point sorted by.
+        void Push(Mesh& mesh, Shader& shader, GLuint drawID, GLsizei instanceCount, unsigned state, const glm::vec3& center);
+
+        // Sorts and submits the collected draws, culling is left on and blending off afterwards
+        void Execute();
+
+    private:
+        struct Item
+        {
+            Mesh* mesh;
+            Shader* shader;
+            GLuint drawID;
+            // 0 for a plain draw
+            GLsizei instanceCount;
+            unsigned state;
+        };
+
+        // layout read by glMultiDrawElementsIndirect
+        struct DrawElementsIndirectCommand
+        {
+            GLuint count;
+            GLuint instanceCount;
+            GLuint firstIndex;
+            GLint baseVertex;
+            GLuint baseInstance;
+        };
+
+        // draws [first, first + count) of the command list, all sharing the state of the item in front
+        struct Batch
+        {
+            uint32_t item;
+            GLuint first;
+            GLsizei count;
+        };
+
+        unsigned pass = 0;
+        glm::mat4 viewProjection;
+        bool useTextures = true;
+
+        std::vector<Item> items;
+        std::vector<uint64_t> keys;
+        // item indices in key order, and the scratch copy of the radix sort
+        std::vector<uint32_t> order;
+        std::vector<uint32_t> scratch;
+
+        std::vector<DrawElementsIndirectCommand> commands;
+        std::vector<Batch> batches;
+        gps::BufferHandle indirectBuffer;
+
+        uint64_t MakeKey(const Item& item, const glm::vec3& center) const;
+
+        // LSD radix sort of the item indices by key, one byte per round
+        void Sort();
+
+        // Builds the commands and splits them into batches, returns the triangles they draw
+        size_t BuildBatches();
+
+        // Whether the second item can join the multi-draw of the first
+        bool SameBatch(const Item& a, const Item& b) const;
+
+        static bool SameTextures(const Mesh& a, const Mesh& b);
+    };
+}
+
+#endif /* RenderQueue_hpp */
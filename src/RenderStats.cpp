@@ -0,0 +1,99 @@
+#include "RenderStats.hpp"
+
+namespace gps {
+
+    namespace {
+
+        const char* const COUNTER_NAMES[RenderStats::COUNTER_COUNT] = {
+            "draw calls",
+            "triangles",
+            "vertices",
+            "program binds",
+            "texture binds",
+            "uniform uploads",
+            "buffer bytes",
+            "culled objects",
+            "state calls",
+            "elided state calls"
+        };
+    }
+
+    RenderStats& RenderStats::Get()
+    {
+        static RenderStats stats;
+        return stats;
+    }
+
+    RenderStats::RenderStats() : pass(0)
+    {
+        BeginPass("update");
+        last = current;
+    }
+
+    // Keeps the frame in progress as the last one and starts over in the "update" pass
+    void RenderStats::BeginFrame()
+    {
+        last = current;
+        for (size_t i = 0; i < current.size(); i++)
+            current[i] = PassCounters();
+        pass = 0;
+    }
+
+    // Counts from now on into the pass, the pass is added the first time it is named
+    void RenderStats::BeginPass(const char* name)
+    {
+        pass = FindPass(name);
+        if (pass >= 0)
+            return;
+
+        passNames.push_back(name);
+        current.push_back(PassCounters());
+        last.push_back(PassCounters());
+        pass = (int)passNames.size() - 1;
+    }
+
+    size_t RenderStats::GetCurrent(Counter counter, int pass) const
+    {
+        return Sum(current, counter, pass);
+    }
+
+    size_t RenderStats::GetLast(Counter counter, int pass) const
+    {
+        return Sum(last, counter, pass);
+    }
+
+    int RenderStats::FindPass(const std::string& name) const
+    {
+        for (size_t i = 0; i < passNames.size(); i++) {
+            if (passNames[i] == name)
+                return (int)i;
+        }
+        return -1;
+    }
+
+    int RenderStats::GetPassCount() const
+    {
+        return (int)passNames.size();
+    }
+
+    const std::string& RenderStats::GetPassName(int pass) const
+    {
+        return passNames[pass];
+    }
+
+    const char* RenderStats::GetCounterName(Counter counter)
+    {
+        return COUNTER_NAMES[counter];
+    }
+
+    size_t RenderStats::Sum(const std::vector<PassCounters>& passes, Counter counter, int pass)
+    {
+        if (pass != ALL_PASSES)
+            return pass >= 0 && pass < (int)passes.size() ? passes[pass].values[counter] : 0;
+
+        size_t total = 0;
+        for (size_t i = 0; i < passes.size(); i++)
+            total += passes[i].values[counter];
+        return total;
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef RenderStats_hpp
+#define RenderStats_hpp
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Counters of what the renderer asked of the GL, kept per pass for every frame. The code issuing
+    // the calls counts them, the frame in progress can be read while it is recorded and the previous
+    // one stays readable for the whole next frame.
+    class RenderStats
+    {
+    public:
+        enum Counter
+        {
+            DRAW_CALLS,
+            TRIANGLES,
+            // vertex shader inputs, the index count times the instances for indexed draws
+            VERTICES,
+            PROGRAM_BINDS,
+            TEXTURE_BINDS,
+            UNIFORM_UPLOADS,
+            BUFFER_BYTES,
+            // meshes and instances left out by frustum culling
+            CULLED_OBJECTS,
+            // state changes made and dropped by the GLStateCache
+            STATE_CALLS,
+            ELIDED_STATE_CALLS,
+            COUNTER_COUNT
+        };
+
+        // Sums the counters of every pass
+        static const int ALL_PASSES = -1;
+
+        // The counters of the context, there is only one
+        static RenderStats& Get();
+
+        // Keeps the frame in progress as the last one and starts over in the "update" pass
+        void BeginFrame();
+
+        // Counts from now on into the pass, the pass is added the first time it is named
+        void BeginPass(const char* name);
+
+        void Add(Counter counter, size_t amount = 1)
+        {
+            current[pass].values[counter] += amount;
+        }
+
+        // Counters of the frame in progress and of the last finished frame
+        size_t GetCurrent(Counter counter, int pass = ALL_PASSES) const;
+        size_t GetLast(Counter counter, int pass = ALL_PASSES) const;
+
+        // Index of the pass for the getters, -1 if it was never named
+        int FindPass(const std::string& name) const;
+        int GetPassCount() const;
+        const std::string& GetPassName(int pass) const;
+
+        static const char* GetCounterName(Counter counter);
+
+    private:
+        struct PassCounters
+        {
+            size_t values[COUNTER_COUNT];
+        };
+
+        std::vector<std::string> passNames;
+        std::vector<PassCounters> current;
+        std::vector<PassCounters> last;
+        int pass;
+
+        RenderStats();
+
+        static size_t Sum(const std::vector<PassCounters>& passes, Counter counter, int pass);
+
+        RenderStats(const RenderStats&);
+        RenderStats& operator=(const RenderStats&);
+    };
+}
+
+#endif /* RenderStats_hpp */
@@ -7,8 +7,56 @@
 //
 
 #include "Shader.hpp"
+#include "GLStateCache.hpp"
+#include "RenderStats.hpp"
+
+#include <cstring>
 
 namespace gps {
+
+    namespace {
+
+        const char PROGRAM_MAGIC[8] = { 'G', 'P', 'S', 'P', 'R', 'O', 'G', '\0' };
+        //bump whenever the file layout changes
+        const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+        struct ProgramBinaryHeader
+        {
+            char magic[8];
+            uint32_t version;
+            //binary format reported by the driver
+            uint32_t format;
+            uint64_t key;
+            uint64_t length;
+        };
+
+        // 64-bit FNV-1a
+        uint64_t hashString(const std::string& value, uint64_t hash)
+        {
+            for (size_t i = 0; i < value.size(); i++) {
+                hash ^= (unsigned char)value[i];
+                hash *= 1099511628211ull;
+            }
+            //separator, so that moving text between strings changes the hash
+            hash ^= 0xff;
+            hash *= 1099511628211ull;
+            return hash;
+        }
+
+        std::string glString(GLenum name)
+        {
+            const GLubyte* value = glGetString(name);
+            return value ? std::string((const char*)value) : std::string();
+        }
+
+        //drivers without any binary format cannot give programs back
+        bool programBinariesSupported()
+        {
+            GLint formats = 0;
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+            return formats > 0;
+        }
+    }
     std::string Shader::readShaderFile(std::string fileName)
     {
         std::ifstream shaderFile;
@@ -30,6 +78,25 @@ namespace gps {
         return shaderString;
     }
     
+    std::string Shader::injectDefines(const std::string& source, const std::vector<std::string>& defines)
+    {
+        if (defines.empty())
+            return source;
+
+        std::string block;
+        for (size_t i = 0; i < defines.size(); i++)
+            block += "#define " + defines[i] + "\n";
+
+        //#version has to stay the first directive
+        size_t version = source.find("#version");
+        if (version == std::string::npos)
+            return block + source;
+        size_t lineEnd = source.find('\n', version);
+        if (lineEnd == std::string::npos)
+            return source + "\n" + block;
+        return source.substr(0, lineEnd + 1) + block + source.substr(lineEnd + 1);
+    }
+
     void Shader::shaderCompileLog(GLuint shaderId)
     {
         GLint success;
@@ -57,10 +124,111 @@ namespace gps {
         }
     }
     
-    void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName)
+    std::string Shader::programCachePath(const std::string& vertexShaderFileName, const std::vector<std::string>& variant)
     {
-        //read, parse and compile the vertex shader
-        std::string v = readShaderFile(vertexShaderFileName);
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < variant.size(); i++)
+            hash = hashString(variant[i], hash);
+
+        char name[32];
+        snprintf(name, sizeof(name), ".%016llx.gpsprog", (unsigned long long)hash);
+        return vertexShaderFileName + name;
+    }
+
+    uint64_t Shader::programKey(const std::vector<std::string>& sources)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < sources.size(); i++)
+            hash = hashString(sources[i], hash);
+        //a binary only works with the driver that produced it
+        hash = hashString(glString(GL_VENDOR), hash);
+        hash = hashString(glString(GL_RENDERER), hash);
+        hash = hashString(glString(GL_VERSION), hash);
+        return hash;
+    }
+
+    bool Shader::loadProgramBinary(const std::string& path, uint64_t key)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+            return false;
+
+        ProgramBinaryHeader header;
+        if (!in.read((char*)&header, sizeof(header)) ||
+            memcmp(header.magic, PROGRAM_MAGIC, sizeof(PROGRAM_MAGIC)) != 0 ||
+            header.version != PROGRAM_CACHE_VERSION ||
+            header.key != key ||
+            header.length == 0)
+            return false;
+
+        std::vector<char> binary(header.length);
+        if (!in.read(&binary[0], binary.size()))
+            return false;
+
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, header.format, &binary[0], (GLsizei)binary.size());
+
+        //the driver may reject binaries even with the same strings, e.g. after an update
+        GLint success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            glDeleteProgram(program);
+            return false;
+        }
+
+        this->shaderProgram = program;
+        return true;
+    }
+
+    void Shader::saveProgramBinary(const std::string& path, uint64_t key)
+    {
+        GLint success = 0;
+        glGetProgramiv(this->shaderProgram, GL_LINK_STATUS, &success);
+        if (!success || !programBinariesSupported())
+            return;
+
+        GLint length = 0;
+        glGetProgramiv(this->shaderProgram, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(this->shaderProgram, length, &length, &format, &binary[0]);
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cout << "Could not write program cache " << path << std::endl;
+            return;
+        }
+
+        ProgramBinaryHeader header;
+        memcpy(header.magic, PROGRAM_MAGIC, sizeof(PROGRAM_MAGIC));
+        header.version = PROGRAM_CACHE_VERSION;
+        header.format = format;
+        header.key = key;
+        header.length = length;
+        out.write((const char*)&header, sizeof(header));
+        out.write(&binary[0], length);
+    }
+
+    void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName,
+                            const std::vector<std::string>& defines)
+    {
+        std::string v = injectDefines(readShaderFile(vertexShaderFileName), defines);
+        std::string f = injectDefines(readShaderFile(fragmentShaderFileName), defines);
+
+        //warm starts take the linked program from the cache and skip the compiler
+        std::vector<std::string> variant = defines;
+        variant.push_back(fragmentShaderFileName);
+        std::string cachePath = programCachePath(vertexShaderFileName, variant);
+        uint64_t key = programKey({ v, f });
+        if (loadProgramBinary(cachePath, key)) {
+            reflectUniforms();
+            return;
+        }
+
+        //parse and compile the vertex shader
         const GLchar* vertexShaderString = v.c_str();
         GLuint vertexShader;
         vertexShader = glCreateShader(GL_VERTEX_SHADER);
@@ -69,8 +237,7 @@ namespace gps {
         //check compilation status
         shaderCompileLog(vertexShader);
         
-        //read, parse and compile the vertex shader
-        std::string f = readShaderFile(fragmentShaderFileName);
+        //parse and compile the fragment shader
         const GLchar* fragmentShaderString = f.c_str();
         GLuint fragmentShader;
         fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
@@ -83,16 +250,168 @@ namespace gps {
         this->shaderProgram = glCreateProgram();
         glAttachShader(this->shaderProgram, vertexShader);
         glAttachShader(this->shaderProgram, fragmentShader);
+        glProgramParameteri(this->shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         glLinkProgram(this->shaderProgram);
         glDeleteShader(vertexShader);
         glDeleteShader(fragmentShader);
         //check linking info
         shaderLinkLog(this->shaderProgram);
+        saveProgramBinary(cachePath, key);
+        reflectUniforms();
+    }
+    
+    void Shader::loadFeedbackShader(std::string vertexShaderFileName, std::vector<const GLchar*> varyings)
+    {
+        std::string v = readShaderFile(vertexShaderFileName);
+
+        //the captured outputs are part of the linked program, so they are part of the key too
+        std::vector<std::string> variant(1, "feedback");
+        variant.insert(variant.end(), varyings.begin(), varyings.end());
+        std::string cachePath = programCachePath(vertexShaderFileName, variant);
+        variant[0] = v;
+        uint64_t key = programKey(variant);
+        if (loadProgramBinary(cachePath, key)) {
+            reflectUniforms();
+            return;
+        }
+
+        //parse and compile the vertex shader
+        const GLchar* vertexShaderString = v.c_str();
+        GLuint vertexShader;
+        vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertexShader, 1, &vertexShaderString, NULL);
+        glCompileShader(vertexShader);
+        //check compilation status
+        shaderCompileLog(vertexShader);
+        
+        //the captured outputs have to be declared before linking
+        this->shaderProgram = glCreateProgram();
+        glAttachShader(this->shaderProgram, vertexShader);
+        glTransformFeedbackVaryings(this->shaderProgram, varyings.size(), varyings.data(), GL_INTERLEAVED_ATTRIBS);
+        glProgramParameteri(this->shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(this->shaderProgram);
+        glDeleteShader(vertexShader);
+        //check linking info
+        shaderLinkLog(this->shaderProgram);
+        saveProgramBinary(cachePath, key);
+        reflectUniforms();
     }
     
     void Shader::useShaderProgram()
     {
-        glUseProgram(this->shaderProgram);
+        GLStateCache::Get().UseProgram(this->shaderProgram);
+    }
+
+    void Shader::reflectUniforms()
+    {
+        uniforms.clear();
+
+        //the table only keeps the hashes, two names sharing one would silently set each other
+        std::unordered_map<UniformHash, std::string> names;
+        auto addUniform = [&](const std::string& name, GLint location) {
+            UniformHash hash = uniformHash(name.c_str());
+            auto added = names.insert(std::make_pair(hash, name));
+            if (!added.second && added.first->second != name) {
+                std::cout << "ERROR: uniforms " << added.first->second << " and " << name
+                          << " have the same hash, " << name << " cannot be set" << std::endl;
+                return;
+            }
+            Uniform uniform = { location, {}, false };
+            uniforms[hash] = uniform;
+        };
+
+        GLint uniformCount = 0;
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORMS, &uniformCount);
+
+        for (GLint i = 0; i < uniformCount; i++)
+        {
+            GLchar name[256];
+            GLsizei length;
+            GLint size;
+            GLenum type;
+            glGetActiveUniform(this->shaderProgram, i, sizeof(name), &length, &size, &type, name);
+
+            GLint location = glGetUniformLocation(this->shaderProgram, name);
+            //uniform block members have no location
+            if (location == -1)
+                continue;
+
+            std::string baseName(name, length);
+            addUniform(baseName, location);
+
+            //arrays are reported as "name[0]", register "name" and every element too
+            if (size > 1 && baseName.size() > 3 && baseName.compare(baseName.size() - 3, 3, "[0]") == 0)
+            {
+                baseName.resize(baseName.size() - 3);
+                addUniform(baseName, location);
+                for (GLint element = 1; element < size; element++)
+                    addUniform(baseName + "[" + std::to_string(element) + "]", location + element);
+            }
+        }
+    }
+
+    GLint Shader::getUniformLocation(UniformHash name)
+    {
+        std::unordered_map<UniformHash, Uniform>::iterator it = uniforms.find(name);
+        return it == uniforms.end() ? -1 : it->second.location;
+    }
+
+    Shader::Uniform* Shader::changedUniform(UniformHash name, const void* value, size_t size)
+    {
+        std::unordered_map<UniformHash, Uniform>::iterator it = uniforms.find(name);
+        if (it == uniforms.end())
+            return NULL;
+
+        Uniform& uniform = it->second;
+        if (uniform.valid && memcmp(uniform.value, value, size) == 0)
+            return NULL;
+
+        memcpy(uniform.value, value, size);
+        uniform.valid = true;
+        RenderStats::Get().Add(RenderStats::UNIFORM_UPLOADS);
+        return &uniform;
+    }
+
+    void Shader::setInt(UniformHash name, GLint value)
+    {
+        if (Uniform* uniform = changedUniform(name, &value, sizeof(value)))
+            glProgramUniform1i(this->shaderProgram, uniform->location, value);
+    }
+
+    void Shader::setUint(UniformHash name, GLuint value)
+    {
+        if (Uniform* uniform = changedUniform(name, &value, sizeof(value)))
+            glProgramUniform1ui(this->shaderProgram, uniform->location, value);
+    }
+
+    void Shader::setFloat(UniformHash name, GLfloat value)
+    {
+        if (Uniform* uniform = changedUniform(name, &value, sizeof(value)))
+            glProgramUniform1f(this->shaderProgram, uniform->location, value);
+    }
+
+    void Shader::setVec2(UniformHash name, const glm::vec2& value)
+    {
+        if (Uniform* uniform = changedUniform(name, &value, sizeof(value)))
+            glProgramUniform2fv(this->shaderProgram, uniform->location, 1, &value.x);
+    }
+
+    void Shader::setVec3(UniformHash name, const glm::vec3& value)
+    {
+        if (Uniform* uniform = changedUniform(name, &value, sizeof(value)))
+            glProgramUniform3fv(this->shaderProgram, uniform->location, 1, &value.x);
+    }
+
+    void Shader::setMat3(UniformHash name, const glm::mat3& value)
+    {
+        if (Uniform* uniform = changedUniform(name, &value, sizeof(value)))
+            glProgramUniformMatrix3fv(this->shaderProgram, uniform->location, 1, GL_FALSE, &value[0].x);
+    }
+
+    void Shader::setMat4(UniformHash name, const glm::mat4& value)
+    {
+        if (Uniform* uniform = changedUniform(name, &value, sizeof(value)))
+            glProgramUniformMatrix4fv(this->shaderProgram, uniform->location, 1, GL_FALSE, &value[0].x);
     }
 
 }
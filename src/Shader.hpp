@@ -12,24 +12,79 @@
 #define GLEW_STATIC
 #include <GL/glew.h>
 
+#include "glm/glm.hpp"
+
+#include <cstdint>
 #include <cstdio>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace gps {
+
+typedef GLuint UniformHash;
+
+//FNV-1a hash of a uniform name, evaluated at compile time for constexpr names
+constexpr UniformHash uniformHash(const char* name, UniformHash hash = 2166136261u)
+{
+    return *name == '\0' ? hash : uniformHash(name + 1, (hash ^ (unsigned char)*name) * 16777619u);
+}
     
 class Shader
 {
 public:
     GLuint shaderProgram;
-    void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName);
+    //every name in defines is #defined in both stages, right after the #version line
+    void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName,
+                    const std::vector<std::string>& defines = std::vector<std::string>());
+    //vertex-only program whose outputs are captured with transform feedback
+    void loadFeedbackShader(std::string vertexShaderFileName, std::vector<const GLchar*> varyings);
     void useShaderProgram();
+
+    //location of an active uniform, -1 if the program does not use it
+    GLint getUniformLocation(UniformHash name);
+
+    //typed setters, the value is only sent when it differs from the last one sent
+    //they do not need the program to be in use
+    void setInt(UniformHash name, GLint value);
+    void setUint(UniformHash name, GLuint value);
+    void setFloat(UniformHash name, GLfloat value);
+    void setVec2(UniformHash name, const glm::vec2& value);
+    void setVec3(UniformHash name, const glm::vec3& value);
+    void setMat3(UniformHash name, const glm::mat3& value);
+    void setMat4(UniformHash name, const glm::mat4& value);
     
 private:
+    struct Uniform
+    {
+        GLint location;
+        //last value sent, compared bitwise
+        GLuint value[16];
+        bool valid;
+    };
+
+    //every active uniform of the program, keyed by the hash of its name
+    std::unordered_map<UniformHash, Uniform> uniforms;
+
+    //fills the uniform table once the program is linked
+    void reflectUniforms();
+    //returns the uniform if it exists and its cached value differs, updating the cache
+    Uniform* changedUniform(UniformHash name, const void* value, size_t size);
+
     std::string readShaderFile(std::string fileName);
+
+    //program binaries are cached in a sidecar of the vertex shader (<vertex>.<variant>.gpsprog),
+    //keyed by a hash of the sources and of the driver strings
+    static std::string programCachePath(const std::string& vertexShaderFileName, const std::vector<std::string>& variant);
+    static uint64_t programKey(const std::vector<std::string>& sources);
+    //replaces shaderProgram with the cached binary, fails if it is missing, stale or rejected by the driver
+    bool loadProgramBinary(const std::string& path, uint64_t key);
+    void saveProgramBinary(const std::string& path, uint64_t key);
+    static std::string injectDefines(const std::string& source, const std::vector<std::string>& defines);
     void shaderCompileLog(GLuint shaderId);
     void shaderLinkLog(GLuint shaderProgramId);
 };
@@ -0,0 +1,118 @@
+#include "ShaderPermutations.hpp"
+
+#include <cstring>
+
+namespace gps {
+
+    void ShaderPermutations::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName,
+                                        std::vector<std::string> featureNames)
+    {
+        this->vertexShaderFileName = vertexShaderFileName;
+        this->fragmentShaderFileName = fragmentShaderFileName;
+        this->featureNames = featureNames;
+        programs.clear();
+    }
+
+    // Program with the given features, built on first use
+    Shader& ShaderPermutations::Get(unsigned features)
+    {
+        std::unordered_map<unsigned, Shader>::iterator it = programs.find(features);
+        if (it != programs.end())
+            return it->second;
+
+        std::vector<std::string> defines;
+        for (size_t i = 0; i < featureNames.size(); i++) {
+            if (features & (1u << i))
+                defines.push_back(featureNames[i]);
+        }
+
+        Shader& shader = programs[features];
+        shader.loadShader(vertexShaderFileName, fragmentShaderFileName, defines);
+
+        //catch up with the shared uniforms sent before this permutation existed
+        for (std::unordered_map<UniformHash, SharedValue>::iterator value = sharedValues.begin();
+             value != sharedValues.end(); ++value)
+            apply(shader, value->first, value->second);
+
+        return shader;
+    }
+
+    size_t ShaderPermutations::GetProgramCount() const
+    {
+        return programs.size();
+    }
+
+    void ShaderPermutations::share(UniformHash name, ValueType type, const void* value, size_t size)
+    {
+        SharedValue& shared = sharedValues[name];
+        shared.type = type;
+        memcpy(shared.value, value, size);
+
+        //the programs skip the values they already have
+        for (std::unordered_map<unsigned, Shader>::iterator it = programs.begin(); it != programs.end(); ++it)
+            apply(it->second, name, shared);
+    }
+
+    void ShaderPermutations::apply(Shader& shader, UniformHash name, const SharedValue& shared)
+    {
+        const void* value = shared.value;
+        switch (shared.type) {
+        case INT:
+            shader.setInt(name, *(const GLint*)value);
+            break;
+        case UINT:
+            shader.setUint(name, *(const GLuint*)value);
+            break;
+        case FLOAT:
+            shader.setFloat(name, *(const GLfloat*)value);
+            break;
+        case VEC2:
+            shader.setVec2(name, *(const glm::vec2*)value);
+            break;
+        case VEC3:
+            shader.setVec3(name, *(const glm::vec3*)value);
+            break;
+        case MAT3:
+            shader.setMat3(name, *(const glm::mat3*)value);
+            break;
+        case MAT4:
+            shader.setMat4(name, *(const glm::mat4*)value);
+            break;
+        }
+    }
+
+    void ShaderPermutations::setInt(UniformHash name, GLint value)
+    {
+        share(name, INT, &value, sizeof(value));
+    }
+
+    void ShaderPermutations::setUint(UniformHash name, GLuint value)
+    {
+        share(name, UINT, &value, sizeof(value));
+    }
+
+    void ShaderPermutations::setFloat(UniformHash name, GLfloat value)
+    {
+        share(name, FLOAT, &value, sizeof(value));
+    }
+
+    void ShaderPermutations::setVec2(UniformHash name, const glm::vec2& value)
+    {
+        share(name, VEC2, &value, sizeof(value));
+    }
+
+    void ShaderPermutations::setVec3(UniformHash name, const glm::vec3& value)
+    {
+        share(name, VEC3, &value, sizeof(value));
+    }
+
+    void ShaderPermutations::setMat3(UniformHash name, const glm::mat3& value)
+    {
+        share(name, MAT3, &value, sizeof(value));
+    }
+
+    void ShaderPermutations::setMat4(UniformHash name, const glm::mat4& value)
+    {
+        share(name, MAT4, &value, sizeof(value));
+    }
+}
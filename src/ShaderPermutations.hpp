@@ -0,0 +1,58 @@
+#ifndef ShaderPermutations_hpp
+#define ShaderPermutations_hpp
+
+#include "Shader.hpp"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gps {
+
+    // Compile-time variants of one vertex/fragment shader pair. Bit i of a feature mask
+    // #defines featureNames[i], every mask is compiled the first time it is asked for and
+    // kept for the lifetime of the set.
+    class ShaderPermutations
+    {
+    public:
+        void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName,
+                        std::vector<std::string> featureNames);
+
+        // Program with the given features, built on first use
+        Shader& Get(unsigned features);
+
+        // Number of programs built so far
+        size_t GetProgramCount() const;
+
+        // Shared uniforms, sent to every permutation including the ones built later.
+        // Per-draw values should be set on the program returned by Get instead.
+        void setInt(UniformHash name, GLint value);
+        void setUint(UniformHash name, GLuint value);
+        void setFloat(UniformHash name, GLfloat value);
+        void setVec2(UniformHash name, const glm::vec2& value);
+        void setVec3(UniformHash name, const glm::vec3& value);
+        void setMat3(UniformHash name, const glm::mat3& value);
+        void setMat4(UniformHash name, const glm::mat4& value);
+
+    private:
+        enum ValueType { INT, UINT, FLOAT, VEC2, VEC3, MAT3, MAT4 };
+
+        struct SharedValue
+        {
+            ValueType type;
+            GLuint value[16];
+        };
+
+        std::string vertexShaderFileName;
+        std::string fragmentShaderFileName;
+        std::vector<std::string> featureNames;
+
+        std::unordered_map<unsigned, Shader> programs;
+        std::unordered_map<UniformHash, SharedValue> sharedValues;
+
+        void share(UniformHash name, ValueType type, const void* value, size_t size);
+        static void apply(Shader& shader, UniformHash name, const SharedValue& shared);
+    };
+}
+
+#endif /* ShaderPermutations_hpp */
@@ -0,0 +1,207 @@
+#include "TextOverlay.hpp"
+#include "GLStateCache.hpp"
+#include "RenderStats.hpp"
+
+#include <cstddef>
+
+namespace gps {
+
+    namespace {
+
+        //uniform names
+        constexpr UniformHash screenSizeUniform = uniformHash("screenSize");
+        constexpr UniformHash fontUniform = uniformHash("font");
+
+        // Rows of every glyph from the top, bit 4 is the leftmost column
+        const unsigned char GLYPHS[64][7] = {
+            { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // ' '
+            { 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 }, // '!'
+            { 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '"'
+            { 0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A }, // '#'
+            { 0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04 }, // '$'
+            { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 }, // '%'
+            { 0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D }, // '&'
+            { 0x04, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '\''
+            { 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 }, // '('
+            { 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 }, // ')'
+            { 0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00 }, // '*'
+            { 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 }, // '+'
+            { 0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08 }, // ','
+            { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 }, // '-'
+            { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C }, // '.'
+            { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 }, // '/'
+            { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E }, // '0'
+            { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E }, // '1'
+            { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F }, // '2'
+            { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E }, // '3'
+            { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 }, // '4'
+            { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E }, // '5'
+            { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E }, // '6'
+            { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 }, // '7'
+            { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E }, // '8'
+            { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C }, // '9'
+            { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 }, // ':'
+            { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08 }, // ';'
+            { 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 }, // '<'
+            { 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00 }, // '='
+            { 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 }, // '>'
+            { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // '?'
+            { 0x0E, 0x11, 0x01, 0x0D, 0x15, 0x15, 0x0E }, // '@'
+            { 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // 'A'
+            { 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E }, // 'B'
+            { 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E }, // 'C'
+            { 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C }, // 'D'
+            { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F }, // 'E'
+            { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 }, // 'F'
+            { 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F }, // 'G'
+            { 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // 'H'
+            { 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E }, // 'I'
+            { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C }, // 'J'
+            { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 }, // 'K'
+            { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F }, // 'L'
+            { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 }, // 'M'
+            { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 }, // 'N'
+            { 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // 'O'
+            { 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 }, // 'P'
+            { 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D }, // 'Q'
+            { 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 }, // 'R'
+            { 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E }, // 'S'
+            { 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, // 'T'
+            { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // 'U'
+            { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 }, // 'V'
+            { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A }, // 'W'
+            { 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 }, // 'X'
+            { 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04, 0x04 }, // 'Y'
+            { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F }, // 'Z'
+            { 0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E }, // '['
+            { 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00 }, // '\\'
+            { 0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E }, // ']'
+            { 0x04, 0x0A, 0x11, 0x00, 0x00, 0x00, 0x00 }, // '^'
+            { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F }, // '_'
+        };
+    }
+
+    // Loads the shader and the font texture, needs the context
+    void TextOverlay::Init()
+    {
+        shader.loadShader("shaders/textOverlay.vert", "shaders/textOverlay.frag");
+        shader.setInt(fontUniform, 0);
+
+        //the glyphs side by side in one row, a texel per font pixel
+        int atlasWidth = GLYPH_COUNT * GLYPH_WIDTH;
+        std::vector<unsigned char> texels((size_t)atlasWidth * GLYPH_HEIGHT, 0);
+        for (int glyph = 0; glyph < GLYPH_COUNT; glyph++) {
+            for (int row = 0; row < GLYPH_HEIGHT; row++) {
+                for (int column = 0; column < GLYPH_WIDTH; column++) {
+                    if (GLYPHS[glyph][row] & (0x10 >> column))
+                        texels[(size_t)row * atlasWidth + glyph * GLYPH_WIDTH + column] = 255;
+                }
+            }
+        }
+
+        font = gps::TextureHandle::create();
+        GLStateCache::Get().BindTexture(0, GL_TEXTURE_2D, font.get());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, atlasWidth, GLYPH_HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, texels.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+        vao = gps::VertexArrayHandle::create();
+        vbo = gps::BufferHandle::create();
+        GLStateCache::Get().BindVertexArray(vao.get());
+        glBindBuffer(GL_ARRAY_BUFFER, vbo.get());
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, texCoords));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, color));
+        GLStateCache::Get().BindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Whole pixels per font pixel
+    void TextOverlay::SetScale(int scale)
+    {
+        this->scale = scale > 0 ? scale : 1;
+    }
+
+    int TextOverlay::GetScale() const
+    {
+        return scale;
+    }
+
+    // Queues a line, x and y are the pixels from the top left corner to the first character
+    void TextOverlay::AddText(int x, int y, const std::string& text, const glm::vec3& color)
+    {
+        glm::vec4 shadow(0.0f, 0.0f, 0.0f, 0.75f);
+        for (size_t i = 0; i < text.size(); i++) {
+            char c = text[i];
+            if (c >= 'a' && c <= 'z')
+                c = c - 'a' + 'A';
+            int glyph = c - FIRST_GLYPH;
+            if (glyph <= 0 || glyph >= GLYPH_COUNT)
+                continue;
+
+            float left = (float)(x + (int)i * CELL_WIDTH * scale);
+            AddGlyph(glyph, left + scale, (float)(y + scale), shadow);
+            AddGlyph(glyph, left, (float)y, glm::vec4(color, 1.0f));
+        }
+    }
+
+    void TextOverlay::AddGlyph(int glyph, float x, float y, const glm::vec4& color)
+    {
+        float width = (float)(GLYPH_WIDTH * scale);
+        float height = (float)(GLYPH_HEIGHT * scale);
+        float u0 = (float)glyph / GLYPH_COUNT;
+        float u1 = (float)(glyph + 1) / GLYPH_COUNT;
+
+        //two triangles, the texture rows go down like the screen rows
+        Vertex corners[4] = {
+            { glm::vec2(x, y), glm::vec2(u0, 0.0f), color },
+            { glm::vec2(x, y + height), glm::vec2(u0, 1.0f), color },
+            { glm::vec2(x + width, y + height), glm::vec2(u1, 1.0f), color },
+            { glm::vec2(x + width, y), glm::vec2(u1, 0.0f), color }
+        };
+        const int order[6] = { 0, 1, 2, 0, 2, 3 };
+        for (int i = 0; i < 6; i++)
+            vertices.push_back(corners[order[i]]);
+    }
+
+    // Draws the queued lines over the framebuffer of the given size and empties the queue
+    void TextOverlay::Draw(int width, int height)
+    {
+        if (vertices.empty())
+            return;
+
+        GLStateCache& state = GLStateCache::Get();
+        RenderStats& stats = RenderStats::Get();
+
+        glBindBuffer(GL_ARRAY_BUFFER, vbo.get());
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        stats.Add(RenderStats::BUFFER_BYTES, vertices.size() * sizeof(Vertex));
+
+        shader.useShaderProgram();
+        shader.setVec2(screenSizeUniform, glm::vec2((float)width, (float)height));
+        state.BindTexture(0, GL_TEXTURE_2D, font.get());
+        state.BindVertexArray(vao.get());
+        state.SetBlend(true);
+        state.SetCullFace(false);
+        glDisable(GL_DEPTH_TEST);
+
+        glDrawArrays(GL_TRIANGLES, 0, (GLsizei)vertices.size());
+        stats.Add(RenderStats::DRAW_CALLS);
+        stats.Add(RenderStats::TRIANGLES, vertices.size() / 3);
+        stats.Add(RenderStats::VERTICES, vertices.size());
+
+        glEnable(GL_DEPTH_TEST);
+        state.SetCullFace(true);
+        state.SetBlend(false);
+        vertices.clear();
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef TextOverlay_hpp
+#define TextOverlay_hpp
+
+#include "GLHandle.hpp"
+#include "Shader.hpp"
+
+#include "glm/glm.hpp"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Lines of text drawn over the frame with a built-in 5x7 bitmap font. The glyphs cover ASCII
+    // from the space to the underscore, lower case letters are drawn as upper case and anything
+    // else as a space. Every glyph gets a drop shadow so the text stays readable over the scene.
+    class TextOverlay
+    {
+    public:
+        // Size of a character on screen before scaling, glyph and spacing
+        static const int CELL_WIDTH = 6;
+        static const int CELL_HEIGHT = 9;
+
+        // Loads the shader and the font texture, needs the context
+        void Init();
+
+        // Whole pixels per font pixel
+        void SetScale(int scale);
+        int GetScale() const;
+
+        // Queues a line, x and y are the pixels from the top left corner to the first character
+        void AddText(int x, int y, const std::string& text, const glm::vec3& color = glm::vec3(1.0f));
+
+        // Draws the queued lines over the framebuffer of the given size and empties the queue
+        void Draw(int width, int height);
+
+    private:
+        static const int GLYPH_WIDTH = 5;
+        static const int GLYPH_HEIGHT = 7;
+        static const char FIRST_GLYPH = ' ';
+        static const int GLYPH_COUNT = 64;
+
+        struct Vertex
+        {
+            glm::vec2 position;
+            glm::vec2 texCoords;
+            glm::vec4 color;
+        };
+
+        gps::Shader shader;
+        gps::TextureHandle font;
+        gps::VertexArrayHandle vao;
+        gps::BufferHandle vbo;
+        std::vector<Vertex> vertices;
+        int scale = 2;
+
+        void AddGlyph(int glyph, float x, float y, const glm::vec4& color);
+    };
+}
+
+#endif /* TextOverlay_hpp */
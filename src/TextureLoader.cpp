@@ -0,0 +1,236 @@
+#include "TextureLoader.hpp"
+#include "CpuProfiler.hpp"
+#include "GLStateCache.hpp"
+
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <utility>
+
+namespace gps {
+
+    namespace {
+
+        const int CHANNELS = 4;
+
+        // Conversion tables, the mip chain is averaged in linear space since the textures are sRGB
+        struct SrgbTables
+        {
+            float toLinear[256];
+            unsigned char fromLinear[4096];
+
+            SrgbTables()
+            {
+                for (int i = 0; i < 256; i++) {
+                    float c = i / 255.0f;
+                    toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+                }
+                for (int i = 0; i < 4096; i++) {
+                    float l = i / 4095.0f;
+                    float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+                    fromLinear[i] = (unsigned char)(c * 255.0f + 0.5f);
+                }
+            }
+        };
+
+        const SrgbTables& srgbTables()
+        {
+            static const SrgbTables tables;
+            return tables;
+        }
+
+        void flipVertically(unsigned char* pixels, int width, int height)
+        {
+            size_t rowBytes = (size_t)width * CHANNELS;
+            for (int row = 0; row < height / 2; row++) {
+                unsigned char* top = pixels + row * rowBytes;
+                unsigned char* bottom = pixels + (height - row - 1) * rowBytes;
+                std::swap_ranges(top, top + rowBytes, bottom);
+            }
+        }
+
+        // 2x2 box filter of an RGBA8 sRGB level, edges are clamped for odd sizes
+        void downsample(const unsigned char* src, int srcWidth, int srcHeight, std::vector<unsigned char>& dst)
+        {
+            const SrgbTables& tables = srgbTables();
+            int dstWidth = std::max(1, srcWidth / 2);
+            int dstHeight = std::max(1, srcHeight / 2);
+            dst.resize((size_t)dstWidth * dstHeight * CHANNELS);
+
+            for (int y = 0; y < dstHeight; y++) {
+                const unsigned char* row0 = src + (size_t)std::min(2 * y, srcHeight - 1) * srcWidth * CHANNELS;
+                const unsigned char* row1 = src + (size_t)std::min(2 * y + 1, srcHeight - 1) * srcWidth * CHANNELS;
+                unsigned char* out = &dst[(size_t)y * dstWidth * CHANNELS];
+                for (int x = 0; x < dstWidth; x++) {
+                    int x0 = std::min(2 * x, srcWidth - 1) * CHANNELS;
+                    int x1 = std::min(2 * x + 1, srcWidth - 1) * CHANNELS;
+                    for (int c = 0; c < 3; c++) {
+                        float sum = tables.toLinear[row0[x0 + c]] + tables.toLinear[row0[x1 + c]] +
+                                    tables.toLinear[row1[x0 + c]] + tables.toLinear[row1[x1 + c]];
+                        out[c] = tables.fromLinear[(int)(sum * 0.25f * 4095.0f + 0.5f)];
+                    }
+                    out[3] = (unsigned char)((row0[x0 + 3] + row0[x1 + 3] + row1[x0 + 3] + row1[x1 + 3] + 2) / 4);
+                    out += CHANNELS;
+                }
+            }
+        }
+    }
+
+    TextureLoader::TextureLoader(unsigned workerCount) : workerCount(workerCount), pending(0), stopping(false)
+    {
+        if (this->workerCount == 0)
+            this->workerCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    TextureLoader::~TextureLoader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        jobReady.notify_all();
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+
+    std::shared_ptr<TextureHandle> TextureLoader::Request(const std::string& path)
+    {
+        // the workers are only started once there is something to decode
+        if (workers.empty()) {
+            for (unsigned i = 0; i < workerCount; i++)
+                workers.push_back(std::thread(&TextureLoader::WorkerLoop, this));
+        }
+
+        std::shared_ptr<TextureHandle> texture = std::make_shared<TextureHandle>(TextureHandle::create());
+        Job job;
+        job.texture = texture;
+        job.path = path;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(job);
+            pending++;
+        }
+        jobReady.notify_one();
+
+        return texture;
+    }
+
+    void TextureLoader::Finish()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (pending > 0) {
+            imageReady.wait(lock, [this] { return !images.empty(); });
+            std::deque<Image> ready;
+            ready.swap(images);
+
+            // upload while the workers keep decoding
+            lock.unlock();
+            for (size_t i = 0; i < ready.size(); i++)
+                Upload(ready[i]);
+            lock.lock();
+            pending -= ready.size();
+        }
+    }
+
+    void TextureLoader::WorkerLoop()
+    {
+        GPS_PROFILE_THREAD("texture decoder");
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobReady.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping)
+                    return;
+                job = jobs.front();
+                jobs.pop_front();
+            }
+
+            Image image;
+            Decode(job, image);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                images.push_back(std::move(image));
+            }
+            imageReady.notify_one();
+        }
+    }
+
+    // Worker thread. Reads the pixel data from an image file and builds its mip chain
+    void TextureLoader::Decode(const Job& job, Image& image)
+    {
+        GPS_PROFILE_SCOPE("TextureLoader::Decode");
+        image.texture = job.texture;
+        image.path = job.path;
+        image.width = 0;
+        image.height = 0;
+
+        int x, y, n;
+        unsigned char* image_data = stbi_load(job.path.c_str(), &x, &y, &n, CHANNELS);
+        if (!image_data) {
+            fprintf(stderr, "ERROR: could not load %s\n", job.path.c_str());
+            return;
+        }
+        // NPOT check
+        if ((x & (x - 1)) != 0 || (y & (y - 1)) != 0) {
+            fprintf(
+                stderr, "WARNING: texture %s is not power-of-2 dimensions\n", job.path.c_str()
+            );
+        }
+
+        flipVertically(image_data, x, y);
+
+        image.width = x;
+        image.height = y;
+        image.levels.push_back(std::vector<unsigned char>(image_data, image_data + (size_t)x * y * CHANNELS));
+        stbi_image_free(image_data);
+
+        int width = x;
+        int height = y;
+        while (width > 1 || height > 1) {
+            image.levels.push_back(std::vector<unsigned char>());
+            downsample(&image.levels[image.levels.size() - 2][0], width, height, image.levels.back());
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+    }
+
+    // GL thread. Loads a decoded image and its mip chain into the video memory
+    void TextureLoader::Upload(const Image& image)
+    {
+        GPS_PROFILE_SCOPE("TextureLoader::Upload");
+        std::shared_ptr<TextureHandle> texture = image.texture.lock();
+        if (!texture || image.levels.empty())
+            return;
+
+        GLStateCache::Get().BindTexture(0, GL_TEXTURE_2D, texture->get());
+
+        int width = image.width;
+        int height = image.height;
+        for (size_t level = 0; level < image.levels.size(); level++) {
+            glTexImage2D(
+                GL_TEXTURE_2D,
+                (GLint)level,
+                GL_SRGB8_ALPHA8,
+                width,
+                height,
+                0,
+                GL_RGBA,
+                GL_UNSIGNED_BYTE,
+                &image.levels[level][0]
+            );
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        GLStateCache::Get().BindTexture(0, GL_TEXTURE_2D, 0);
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef TextureLoader_hpp
+#define TextureLoader_hpp
+
+#include "GLHandle.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace gps {
+
+    // Loads 2D textures in two stages: decoding, flipping and building the mip chain
+    // runs on a pool of worker threads, the finished images are queued and uploaded
+    // on the GL thread by Finish().
+    class TextureLoader
+    {
+    public:
+        // workerCount 0 uses one worker per hardware thread
+        explicit TextureLoader(unsigned workerCount = 0);
+        ~TextureLoader();
+
+        // GL thread. Creates the texture right away and queues the decode, the texture
+        // stays empty until it is uploaded. Textures released before that are skipped.
+        std::shared_ptr<TextureHandle> Request(const std::string& path);
+
+        // GL thread. Blocks until every requested texture has been uploaded
+        void Finish();
+
+    private:
+        struct Job
+        {
+            std::weak_ptr<TextureHandle> texture;
+            std::string path;
+        };
+
+        // Decoded RGBA8 image with its full mip chain, level 0 first
+        struct Image
+        {
+            std::weak_ptr<TextureHandle> texture;
+            std::string path;
+            int width;
+            int height;
+            std::vector<std::vector<unsigned char> > levels;
+        };
+
+        unsigned workerCount;
+        std::vector<std::thread> workers;
+
+        std::mutex mutex;
+        std::condition_variable jobReady;
+        std::condition_variable imageReady;
+        std::deque<Job> jobs;
+        std::deque<Image> images;
+        // requested but not uploaded yet
+        size_t pending;
+        bool stopping;
+
+        void WorkerLoop();
+        static void Decode(const Job& job, Image& image);
+        static void Upload(const Image& image);
+
+        TextureLoader(const TextureLoader&);
+        TextureLoader& operator=(const TextureLoader&);
+    };
+}
+
+#endif /* TextureLoader_hpp */
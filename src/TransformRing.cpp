@@ -0,0 +1,115 @@
+#include "TransformRing.hpp"
+#include "RenderStats.hpp"
+
+#include <iostream>
+#include <vector>
+
+namespace gps {
+
+    TransformRing::TransformRing() : mapping(NULL), frameSize(0), maxDraws(0), frame(0), drawCount(0), overflowReported(false)
+    {
+        for (int i = 0; i < FRAME_COUNT; i++)
+            fences[i] = 0;
+    }
+
+    TransformRing::~TransformRing()
+    {
+        for (int i = 0; i < FRAME_COUNT; i++) {
+            if (fences[i])
+                glDeleteSync(fences[i]);
+        }
+    }
+
+    // Maps room for maxDraws entries per frame, false if the buffer cannot be mapped
+    bool TransformRing::Init(GLuint maxDraws)
+    {
+        this->maxDraws = maxDraws;
+
+        //every part has to start at an offset the storage binding accepts
+        GLint alignment = 256;
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        frameSize = maxDraws * sizeof(DrawTransform);
+        frameSize = (frameSize + alignment - 1) / alignment * alignment;
+
+        //coherent, so the writes need no flush before the draws
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        buffer = gps::BufferHandle::create();
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer.get());
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, frameSize * FRAME_COUNT, NULL, flags);
+        mapping = (unsigned char*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, frameSize * FRAME_COUNT, flags);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        if (mapping == NULL) {
+            std::cout << "Could not map the transform ring" << std::endl;
+            return false;
+        }
+
+        std::vector<GLuint> drawIDs(maxDraws);
+        for (GLuint i = 0; i < maxDraws; i++)
+            drawIDs[i] = i;
+        drawIDBuffer = gps::BufferHandle::create();
+        glBindBuffer(GL_ARRAY_BUFFER, drawIDBuffer.get());
+        glBufferData(GL_ARRAY_BUFFER, drawIDs.size() * sizeof(GLuint), drawIDs.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        frame = 0;
+        drawCount = 0;
+        overflowReported = false;
+        return true;
+    }
+
+    // Moves to the next part of the ring, waiting for the GPU if it still reads it
+    void TransformRing::BeginFrame()
+    {
+        frame = (frame + 1) % FRAME_COUNT;
+        drawCount = 0;
+
+        GLsync& fence = fences[frame];
+        if (!fence)
+            return;
+        //only the first wait flushes, the fence is in the command stream after that
+        GLbitfield waitFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        for (;;) {
+            GLenum result = glClientWaitSync(fence, waitFlags, 1000000);
+            if (result != GL_TIMEOUT_EXPIRED)
+                break;
+            waitFlags = 0;
+        }
+        glDeleteSync(fence);
+        fence = 0;
+    }
+
+    // Writes an entry for this frame and returns its draw ID, INVALID_DRAW if there is no room left
+    GLuint TransformRing::Add(const glm::mat4& model, const glm::mat3& normalMatrix)
+    {
+        if (drawCount == maxDraws) {
+            if (!overflowReported) {
+                std::cout << "Transform ring is full, " << maxDraws << " draws per frame" << std::endl;
+                overflowReported = true;
+            }
+            return INVALID_DRAW;
+        }
+
+        DrawTransform* transforms = (DrawTransform*)(mapping + frame * frameSize);
+        transforms[drawCount].model = model;
+        transforms[drawCount].normalMatrix = glm::mat4(normalMatrix);
+        RenderStats::Get().Add(RenderStats::BUFFER_BYTES, sizeof(DrawTransform));
+        return drawCount++;
+    }
+
+    // Binds this frame's part to BINDING
+    void TransformRing::Bind()
+    {
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, BINDING, buffer.get(), frame * frameSize, frameSize);
+    }
+
+    // Fences the part of this frame, call after its last draw
+    void TransformRing::EndFrame()
+    {
+        fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    GLuint TransformRing::GetDrawIDBuffer() const
+    {
+        return drawIDBuffer.get();
+    }
+}
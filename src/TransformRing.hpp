@@ -0,0 +1,71 @@
+#ifndef TransformRing_hpp
+#define TransformRing_hpp
+
+#include "GLHandle.hpp"
+
+#include "glm/glm.hpp"
+
+namespace gps {
+
+    // Per-draw transforms in a persistently mapped storage buffer split into one part per frame in
+    // flight. The matrices of a frame are written straight into the mapping, the part is only reused
+    // once the fence of the frame that last read it has passed. Shaders find their entry through the
+    // draw ID attribute (location 8), fed from a buffer of 0, 1, 2, ... by the base instance of the draw.
+    class TransformRing
+    {
+    public:
+        // Shader storage binding point of the current frame's part
+        static const GLuint BINDING = 3;
+
+        // Returned by Add when this frame's part is full, the draw has no transform
+        static const GLuint INVALID_DRAW = 0xFFFFFFFF;
+
+        // std430 layout of an entry, the normal matrix is kept in the upper 3x3
+        struct DrawTransform
+        {
+            glm::mat4 model;
+            glm::mat4 normalMatrix;
+        };
+
+        TransformRing();
+        ~TransformRing();
+
+        // Maps room for maxDraws entries per frame, false if the buffer cannot be mapped
+        bool Init(GLuint maxDraws);
+
+        // Moves to the next part of the ring, waiting for the GPU if it still reads it
+        void BeginFrame();
+
+        // Writes an entry for this frame and returns its draw ID, INVALID_DRAW if there is no room left
+        GLuint Add(const glm::mat4& model, const glm::mat3& normalMatrix);
+
+        // Binds this frame's part to BINDING
+        void Bind();
+
+        // Fences the part of this frame, call after its last draw
+        void EndFrame();
+
+        // Buffer of consecutive draw IDs, see GeometryArena::SetDrawIDBuffer
+        GLuint GetDrawIDBuffer() const;
+
+    private:
+        static const int FRAME_COUNT = 3;
+
+        gps::BufferHandle buffer;
+        gps::BufferHandle drawIDBuffer;
+        unsigned char* mapping;
+        GLintptr frameSize;
+        GLuint maxDraws;
+
+        int frame;
+        GLuint drawCount;
+        GLsync fences[FRAME_COUNT];
+        // the overflow is only reported once, not on every draw after it
+        bool overflowReported;
+
+        TransformRing(const TransformRing&);
+        TransformRing& operator=(const TransformRing&);
+    };
+}
+
+#endif /* TransformRing_hpp */
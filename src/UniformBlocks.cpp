@@ -0,0 +1,40 @@
+#include "UniformBlocks.hpp"
+#include "RenderStats.hpp"
+
+namespace gps {
+
+    // One block per size, each placed at the offset alignment the driver asks for
+    void UniformBlocks::Init(const std::vector<GLsizeiptr>& blockSizes)
+    {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+        offsets.clear();
+        GLintptr size = 0;
+        for (size_t i = 0; i < blockSizes.size(); i++) {
+            size = (size + alignment - 1) / alignment * alignment;
+            offsets.push_back(size);
+            size += blockSizes[i];
+        }
+        data.assign(size, 0);
+
+        buffer = gps::BufferHandle::create();
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer.get());
+        glBufferData(GL_UNIFORM_BUFFER, data.size(), &data[0], GL_STREAM_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        //orphaning keeps the buffer name, so the ranges only have to be bound once
+        for (size_t i = 0; i < blockSizes.size(); i++)
+            glBindBufferRange(GL_UNIFORM_BUFFER, (GLuint)i, buffer.get(), offsets[i], blockSizes[i]);
+    }
+
+    // Sends every block in one call, orphaning the storage the previous frame may still read
+    void UniformBlocks::Upload()
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer.get());
+        glBufferData(GL_UNIFORM_BUFFER, data.size(), &data[0], GL_STREAM_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        RenderStats::Get().Add(RenderStats::UNIFORM_UPLOADS);
+        RenderStats::Get().Add(RenderStats::BUFFER_BYTES, data.size());
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef UniformBlocks_hpp
+#define UniformBlocks_hpp
+
+#include "GLHandle.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+    // std140 uniform blocks packed into one buffer. The CPU copies are filled in during the
+    // frame and sent together with a single buffer write, block i stays bound to binding point i.
+    class UniformBlocks
+    {
+    public:
+        // One block per size, each placed at the offset alignment the driver asks for
+        void Init(const std::vector<GLsizeiptr>& blockSizes);
+
+        // CPU copy of block index, T has to mirror the std140 layout of the block
+        template <class T>
+        T& Block(size_t index)
+        {
+            return *(T*)&data[offsets[index]];
+        }
+
+        // Sends every block in one call, orphaning the storage the previous frame may still read
+        void Upload();
+
+    private:
+        gps::BufferHandle buffer;
+        std::vector<unsigned char> data;
+        std::vector<GLintptr> offsets;
+    };
+}
+
+#endif /* UniformBlocks_hpp */
@@ -9,7 +9,7 @@
 #define GLEW_STATIC
 #define DUCK_NO 15
 #define DROPLET_NO 6500
-#define POINTLIGHT_NO 4
+#define CASCADE_NO 3
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
@@ -20,11 +20,29 @@
 #include  "glm/gtx/vector_angle.hpp"
 
 #include "Shader.hpp"
+#include "ShaderPermutations.hpp"
 #include "Model3D.hpp"
 #include "Camera.hpp"
 #include "SkyBox.hpp"
-
+#include "RainSystem.hpp"
+#include "LightClusters.hpp"
+#include "UniformBlocks.hpp"
+#include "TransformRing.hpp"
+#include "RenderQueue.hpp"
+#include "GLStateCache.hpp"
+#include "GeometryArena.hpp"
+#include "HeadlessContext.hpp"
+#include "Benchmark.hpp"
+#include "GpuProfiler.hpp"
+#include "CpuProfiler.hpp"
+#include "RenderStats.hpp"
+#include "TextOverlay.hpp"
+
+#include <chrono>
+#include <cmath>
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
 #include <random>
 #include <string>
 #include <time.h>
@@ -37,25 +55,14 @@ struct bezierCurve {
 	glm::vec3 p3;
 };
 
-struct pointLight {
-	glm::vec3 position;
-	float constant, linear, quadratic;
-	glm::vec3 color;
-};
-
+//laid out like the std140 spotLight struct of shaderStart.frag
 struct spotLight {
 	glm::vec3 position;
-	glm::vec3 direction;
 	float cutOff;
+	glm::vec3 direction;
 	float outerCutOff;
 };
 
-struct rainDrop{
-	glm::vec3 position;
-	float speed;
-	int moveCounter;
-};
-
 //camera
 gps::Camera myCamera(
 	glm::vec3(-6.887457f, 4.196992f, 16.786829f),
@@ -69,10 +76,36 @@ int glWindowHeight = 1080;
 int retina_width, retina_height;
 GLFWwindow* glWindow = NULL;
 
-//shadows
-const unsigned int SHADOW_WIDTH = 2048;
-const unsigned int SHADOW_HEIGHT = 2048;
-const GLfloat near_plane = 0.1f, far_plane = 50.0f;
+//headless mode, no window, the frames go into an offscreen framebuffer
+gps::HeadlessContext headlessContext;
+bool headless = false;
+int headlessFrames = 600;
+//framebuffer the scene ends up in, 0 is the window
+GLuint sceneFBO = 0;
+
+//benchmark mode, replays the camera path with one animation step per frame and reports the frame times
+gps::Benchmark benchmark;
+bool benchmarking = false;
+std::string benchmarkReport;
+std::string benchmarkBaseline;
+//allowed growth of the frame times over the baseline, in percent
+double benchmarkThreshold = 10.0;
+
+//seeds the duck paths and the rain, fixed while benchmarking so every run sees the same scene
+unsigned simulationSeed = std::random_device()();
+std::mt19937 randomEngine;
+
+//per pass counters of the last frame, drawn over the scene when enabled
+gps::TextOverlay statsOverlay;
+bool showStats = false;
+
+//shadows, one layer of the depth map per cascade
+const unsigned int SHADOW_WIDTH = 1024;
+const unsigned int SHADOW_HEIGHT = 1024;
+//the cascades split the camera frustum up to this distance
+const GLfloat shadowDistance = 40.0f;
+//0 - uniform splits, 1 - logarithmic splits
+const GLfloat cascadeSplitLambda = 0.75f;
 bool showDepthMap;
 
 bool pressedKeys[1024];
@@ -84,23 +117,17 @@ clock_t end;
 
 //matrices
 glm::mat4 model;
-GLuint modelLoc;
 glm::mat4 view;
-GLuint viewLoc;
 glm::mat4 projection;
-GLuint projectionLoc;
-glm::mat3 normalMatrix;
-GLuint normalMatrixLoc;
 
 //directional light
 glm::vec3 lightDir;
-GLuint lightDirLoc;
 glm::vec3 lightColor;
-GLuint lightColorLoc;
 glm::mat4 lightRotation;
 
-//point light
-pointLight pointLights[POINTLIGHT_NO];
+//point lights, binned into the froxels of the camera every frame
+std::vector<gps::PointLight> pointLights;
+gps::LightClusters lightClusters;
 spotLight mySpotLight;
 
 // angles
@@ -112,7 +139,65 @@ GLfloat gateAngle = 0.0f;
 GLfloat t=0.01f; //bezier
 
 GLfloat fogFactor = 0.005f;
-GLuint fogFactorLoc;
+
+//uniform names, hashed at compile time
+namespace uniforms {
+	constexpr gps::UniformHash model = gps::uniformHash("model");
+	constexpr gps::UniformHash lightSpaceTrMatrix = gps::uniformHash("lightSpaceTrMatrix");
+	constexpr gps::UniformHash shadowMap = gps::uniformHash("shadowMap");
+}
+
+//uniform blocks bound to every program, written once per frame
+//the structs mirror the std140 declarations in the shaders
+enum uniformBlock { FRAME_BLOCK = 0, LIGHT_BLOCK = 1 };
+
+struct FrameData {
+	glm::mat4 view;
+	glm::mat4 projection;
+	float fogDensity;
+	float padding[3];
+};
+
+static_assert(CASCADE_NO <= 4, "the cascade splits are packed in a vec4");
+static_assert(CASCADE_NO >= 2, "the last cascade covers the scene, the others follow the camera");
+struct LightData {
+	glm::mat4 lightSpaceTrMatrices[CASCADE_NO];
+	glm::vec4 cascadeSplits;
+	//eye space, towards the light
+	glm::vec3 lightDir;
+	float padding0;
+	glm::vec3 lightColor;
+	float padding1;
+	spotLight mySpotLight;
+	//froxel tile size, depth slice scale and bias
+	glm::vec4 clusterParams;
+};
+
+gps::UniformBlocks uniformBlocks;
+
+//model and normal matrices of the frame, written once and read by every pass through the draw ID
+gps::TransformRing drawTransforms;
+
+//draws of a pass, sorted by state and depth before they are submitted
+enum renderPass { SHADOW_PASS = 0, COLOR_PASS = 1 };
+gps::RenderQueue renderQueue;
+
+//shader features, compiled in as #defines, bit i is shaderFeatureNames[i]
+enum shaderFeature {
+	FEATURE_INSTANCED = 1 << 0,
+	FEATURE_PARTICLE = 1 << 1,
+	FEATURE_REFLECTIVE = 1 << 2,
+	FEATURE_TRANSPARENT = 1 << 3,
+	FEATURE_POINT_LIGHTS = 1 << 4,
+	FEATURE_SPOT_LIGHT = 1 << 5
+};
+const std::vector<std::string> shaderFeatureNames = {
+	"INSTANCED", "PARTICLE", "REFLECTIVE", "TRANSPARENT", "POINT_LIGHTS", "SPOT_LIGHT"
+};
+//the depth pass only cares about how the vertices are placed
+const unsigned depthFeatures = FEATURE_INSTANCED | FEATURE_PARTICLE;
+//lights toggled from the keyboard, added to every draw of the color pass
+unsigned lightFeatures = 0;
 
 //objects
 gps::SkyBox mySkyBox;
@@ -128,23 +213,91 @@ gps::Model3D monument;
 gps::Model3D dragon;
 gps::Model3D duck;
 gps::Model3D droplet;
-gps::Model3D ducks[DUCK_NO];
-gps::Model3D droplets[DROPLET_NO];
+
+//objects that never move are kept apart so their shadows can be cached
+enum objectSet {
+	STATIC_OBJECTS = 1,
+	DYNAMIC_OBJECTS = 2,
+	ALL_OBJECTS = STATIC_OBJECTS | DYNAMIC_OBJECTS
+};
+
+//where the model matrix of an object comes from, only ring placed objects have an entry in the transform ring
+enum objectPlacement {
+	RING_PLACED,
+	//instanced objects bring their own matrices
+	INSTANCE_PLACED,
+	//drawn on its own with the model uniform
+	UNIFORM_PLACED
+};
+
+//every model of the scene with the file it is loaded from
+struct sceneObject {
+	gps::Model3D* model;
+	const char* fileName;
+	objectSet set;
+	bool castsShadow;
+	objectPlacement placement;
+};
+
+sceneObject sceneObjects[] = {
+	{ &blenderScene, "objects/scene.obj", STATIC_OBJECTS, true, RING_PLACED },
+	{ &lightCube, "objects/cube/cube.obj", DYNAMIC_OBJECTS, false, UNIFORM_PLACED },
+	{ &castleBridge, "objects/castle_bridge.obj", DYNAMIC_OBJECTS, true, RING_PLACED },
+	{ &mill, "objects/mill.obj", DYNAMIC_OBJECTS, true, RING_PLACED },
+	{ &gate[0], "objects/gate1.obj", DYNAMIC_OBJECTS, true, RING_PLACED },
+	{ &gate[1], "objects/gate2.obj", DYNAMIC_OBJECTS, true, RING_PLACED },
+	{ &gate[2], "objects/gate3.obj", DYNAMIC_OBJECTS, true, RING_PLACED },
+	{ &monument, "objects/monument.obj", STATIC_OBJECTS, true, RING_PLACED },
+	{ &duck, "objects/duck.obj", DYNAMIC_OBJECTS, true, INSTANCE_PLACED },
+	{ &droplet, "objects/rain.obj", DYNAMIC_OBJECTS, false, INSTANCE_PLACED },
+	{ &river, "objects/river.obj", STATIC_OBJECTS, true, RING_PLACED },
+	{ &trees, "objects/trees.obj", STATIC_OBJECTS, true, RING_PLACED },
+};
+const int SCENE_OBJECT_NO = sizeof(sceneObjects) / sizeof(sceneObjects[0]);
+
+//model matrix of this frame and its entry in the transform ring, by the index in sceneObjects
+struct objectTransform {
+	glm::mat4 transform;
+	GLuint drawID;
+};
+objectTransform objectTransforms[SCENE_OBJECT_NO];
 
 //vectors
 std::vector<bezierCurve> curves;
-std::vector<rainDrop> rainDrops;
+std::vector<glm::mat4> duckTransforms;
 std::vector<const GLchar*> faces;
 
 //shaders
-gps::Shader myCustomShader;
+gps::ShaderPermutations myCustomShader;
 gps::Shader lightShader;
 gps::Shader screenQuadShader;
-gps::Shader depthMapShader;
+gps::ShaderPermutations depthMapShader;
 gps::Shader skyboxShader;
+gps::Shader rainUpdateShader;
 
-GLuint shadowMapFBO;
+//rain particles
+gps::RainSystem rain;
+
+GLuint shadowMapFBO[CASCADE_NO];
 GLuint depthMapTexture;
+//depth of the static casters around every cascade, in the texel size of the cascade but over a padded
+//extent, a cache is only redrawn when its cascade moves out of the padding or the light moves
+const unsigned int STATIC_CACHE_SIZE = SHADOW_WIDTH + SHADOW_WIDTH / 2;
+GLuint staticCacheFBO[CASCADE_NO];
+GLuint staticCacheTexture;
+glm::mat4 staticCacheMatrices[CASCADE_NO];
+glm::vec2 staticCacheCenters[CASCADE_NO];
+bool staticCacheValid[CASCADE_NO];
+
+//light space matrix and far distance (in eye space) of every cascade
+glm::mat4 cascadeMatrices[CASCADE_NO];
+float cascadeSplits[CASCADE_NO];
+//center (light space x and y) and half size of every cascade, with the light view and depth range they share
+glm::vec3 cascadeExtents[CASCADE_NO];
+glm::mat4 cascadeLightView;
+glm::vec2 cascadeDepthRange;
+//world-space box around every shadow caster
+gps::AABB sceneBounds;
 GLuint textureID;
 
 //mouse input
@@ -197,10 +350,8 @@ void windowResizeCallback(GLFWwindow* window, int width, int height) {
 
 //generate random float between min and max
 float generateBetween(float min, float max) {
-	std::random_device rd;
-	std::mt19937 gen(rd());
 	std::uniform_real_distribution<> dist(min, max);
-	return dist(gen);
+	return dist(randomEngine);
 }
 
 //bezier functions
@@ -267,11 +418,11 @@ void gateMovement(float step) {
 }
 
 void rainMovement() {
-	for (int i = 0; i < DROPLET_NO; i++) {
-		rainDrops.at(i).moveCounter++;
-		if (rainDrops.at(i).position.y - rainDrops.at(i).moveCounter * rainDrops.at(i).speed < 0.0f)
-			rainDrops.at(i).moveCounter = 0;
-	}
+	GPS_PROFILE_FUNCTION();
+	gps::GpuScope scope("rain update");
+	rain.Update(rainUpdateShader);
+	//the simulation ping-pongs between two buffers, draw from the freshly written one
+	droplet.SetInstanceParticles(rain.GetParticleBuffer(), rain.GetParticleCount(), rain.GetBounds());
 }
 
 void duckMovement(float step) {
@@ -293,6 +444,19 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
 	if (key == GLFW_KEY_M && action == GLFW_PRESS)
 		showDepthMap = !showDepthMap;
 
+	//render statistics overlay, it would add to what the benchmark measures
+	if (key == GLFW_KEY_I && action == GLFW_PRESS && !benchmarking)
+		showStats = !showStats;
+
+	//GPU time of every pass
+	if (key == GLFW_KEY_P && action == GLFW_PRESS)
+		gps::GpuProfiler::Get().Print(stdout);
+
+	//CPU zones recorded so far, only with GPS_PROFILE
+	if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+		GPS_PROFILE_WRITE("trace.json");
+	}
+
 	if (key >= 0 && key < 1024)
 	{
 		if (action == GLFW_PRESS)
@@ -303,6 +467,9 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
 }
 
 void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
+	//the benchmark camera only follows the recorded path
+	if (benchmarking)
+		return;
 
 	if (firstMouseInput)
 	{
@@ -330,14 +497,16 @@ void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
 	myCamera.rotate(pitch, yaw);
 	//printf("mouse moved %f %f\n",yaw,pitch);
 	view = myCamera.getViewMatrix();
-	myCustomShader.useShaderProgram();
-	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-	// compute normal matrix for teapot
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 }
 
 void processMovement()
 {
+	GPS_PROFILE_FUNCTION();
+	//no input may change what the benchmark renders
+	if (benchmarking) {
+		return;
+	}
+
 	//solid view
 	if (pressedKeys[GLFW_KEY_1]) {
 		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
@@ -355,25 +524,21 @@ void processMovement()
 
 	//turn pointlights off
 	if (pressedKeys[GLFW_KEY_4]) {
-		myCustomShader.useShaderProgram();
-		glUniform1f(glGetUniformLocation(myCustomShader.shaderProgram, "pointFlag"), 0.0f);
+		lightFeatures &= ~FEATURE_POINT_LIGHTS;
 	}
 	//turn pointlights on
 	if (pressedKeys[GLFW_KEY_5]) {
-		myCustomShader.useShaderProgram();
-		glUniform1f(glGetUniformLocation(myCustomShader.shaderProgram, "pointFlag"), 1.0f);
+		lightFeatures |= FEATURE_POINT_LIGHTS;
 	}
 
 	//turn spotlight off
 	if (pressedKeys[GLFW_KEY_6]) {
-		myCustomShader.useShaderProgram();
-		glUniform1f(glGetUniformLocation(myCustomShader.shaderProgram, "spotFlag"), 0.0f);
+		lightFeatures &= ~FEATURE_SPOT_LIGHT;
 	}
 
 	//turn spotlight on
 	if (pressedKeys[GLFW_KEY_7]) {
-		myCustomShader.useShaderProgram();
-		glUniform1f(glGetUniformLocation(myCustomShader.shaderProgram, "spotFlag"), 1.0f);
+		lightFeatures |= FEATURE_SPOT_LIGHT;
 	}
 	if (pressedKeys[GLFW_KEY_9]) {
 		cameraPreview = false;
@@ -386,10 +551,6 @@ void processMovement()
 		myCamera.move(gps::MOVE_FORWARD, cameraSpeed);
 		//update view matrix
 		view = myCamera.getViewMatrix();
-		myCustomShader.useShaderProgram();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		// compute normal matrix for teapot
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
 
 	//camera move backwards
@@ -397,10 +558,6 @@ void processMovement()
 		myCamera.move(gps::MOVE_BACKWARD, cameraSpeed);
 		//update view matrix
 		view = myCamera.getViewMatrix();
-		myCustomShader.useShaderProgram();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		// compute normal matrix for teapot
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
 
 	//camera move left
@@ -408,10 +565,6 @@ void processMovement()
 		myCamera.move(gps::MOVE_LEFT, cameraSpeed);
 		//update view matrix
 		view = myCamera.getViewMatrix();
-		myCustomShader.useShaderProgram();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		// compute normal matrix for teapot
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
 
 	//camera move right
@@ -419,10 +572,6 @@ void processMovement()
 		myCamera.move(gps::MOVE_RIGHT, cameraSpeed);
 		//update view matrix
 		view = myCamera.getViewMatrix();
-		myCustomShader.useShaderProgram();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		// compute normal matrix for teapot
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
 
 	//camera move up
@@ -430,10 +579,6 @@ void processMovement()
 		myCamera.move(gps::MOVE_UP, cameraSpeed);
 		//update view matrix
 		view = myCamera.getViewMatrix();
-		myCustomShader.useShaderProgram();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		// compute normal matrix for teapot
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
 
 	//camera move down
@@ -441,10 +586,6 @@ void processMovement()
 		myCamera.move(gps::MOVE_DOWN, cameraSpeed);
 		//update view matrix
 		view = myCamera.getViewMatrix();
-		myCustomShader.useShaderProgram();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		// compute normal matrix for teapot
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
 
 	//camera rotate right
@@ -453,10 +594,6 @@ void processMovement()
 		myCamera.rotate(pitch,yaw);
 		//update view matrix
 		view = myCamera.getViewMatrix();
-		myCustomShader.useShaderProgram();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		// compute normal matrix for teapot
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
 
 	//camera rotate left
@@ -465,10 +602,6 @@ void processMovement()
 		myCamera.rotate(pitch, yaw);
 		//update view matrix
 		view = myCamera.getViewMatrix();
-		myCustomShader.useShaderProgram();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		// compute normal matrix for teapot
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
 
 	//open bridge
@@ -521,8 +654,7 @@ void processMovement()
 	//disable rain
 	if (pressedKeys[GLFW_KEY_T]) {
 		startRain = false;
-		for (int i = 0; i < DROPLET_NO; i++)
-			rainDrops.at(i).moveCounter = 0;
+		rain.Reset();
 	}
 }
 
@@ -533,13 +665,9 @@ void initBezierCurves() {
 }
 
 void initDroplets() {
-	for (int i = 0; i < DROPLET_NO; i++) {
-		rainDrop tmp;
-		tmp.position = glm::vec3(generateBetween(xRainMin, xRainMax), generateBetween(yRainMin, yRainMin), generateBetween(zRainMin, zRainMax));
-		tmp.speed = generateBetween(0.03f, 0.10f);
-		tmp.moveCounter = 0;
-		rainDrops.push_back(tmp);
-	}
+	GPS_PROFILE_FUNCTION();
+	rain.Init(DROPLET_NO, glm::vec3(xRainMin, yRainMin, zRainMin), glm::vec3(xRainMax, yRainMax, zRainMax), 0.03f, 0.10f, simulationSeed);
+	droplet.SetInstanceParticles(rain.GetParticleBuffer(), rain.GetParticleCount(), rain.GetBounds());
 }
 
 bool initOpenGLWindow()
@@ -550,7 +678,7 @@ bool initOpenGLWindow()
 	}
 
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	glfwWindowHint(GLFW_SRGB_CAPABLE, GLFW_TRUE);
@@ -587,24 +715,47 @@ bool initOpenGLWindow()
 	return true;
 }
 
+bool initHeadlessContext(int width, int height)
+{
+	if (!headlessContext.Create(width, height)) {
+		return false;
+	}
+
+	const GLubyte* renderer = glGetString(GL_RENDERER);
+	const GLubyte* version = glGetString(GL_VERSION);
+	printf("Renderer: %s\n", renderer);
+	printf("OpenGL version supported %s\n", version);
+
+	retina_width = headlessContext.GetWidth();
+	retina_height = headlessContext.GetHeight();
+	sceneFBO = headlessContext.GetFramebuffer();
+
+	return true;
+}
+
 void initOpenGLState()
 {
 	glClearColor(0.3, 0.3, 0.3, 1.0);
 	glViewport(0, 0, retina_width, retina_height);
 
 	glEnable(GL_DEPTH_TEST); // enable depth-testing
-	glDepthFunc(GL_LESS); // depth-testing interprets a smaller value as "closer"
-	glEnable(GL_CULL_FACE); // cull face
+	gps::GLStateCache::Get().SetDepthFunc(GL_LESS); // depth-testing interprets a smaller value as "closer"
+	gps::GLStateCache::Get().SetCullFace(true); // cull face
 	glCullFace(GL_BACK); // cull back face
 	glFrontFace(GL_CCW); // GL_CCW for counter clock-wise
-	glfwSetInputMode(glWindow, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+	if (glWindow != NULL) {
+		glfwSetInputMode(glWindow, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+	}
 	glEnable(GL_FRAMEBUFFER_SRGB);
+	//blending is toggled by the render queue for the transparent objects
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 }
 
 void initSkybox() {
+	GPS_PROFILE_FUNCTION();
 
 	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+	gps::GLStateCache::Get().BindTexture(0, GL_TEXTURE_CUBE_MAP, textureID);
 
 	faces.push_back("skybox/posx.jpg");
 	faces.push_back("skybox/negx.jpg");
@@ -615,73 +766,80 @@ void initSkybox() {
 
 	mySkyBox.Load(faces);
 	skyboxShader.loadShader("shaders/skyboxShader.vert", "shaders/skyboxShader.frag");
-	skyboxShader.useShaderProgram();
-	view = myCamera.getViewMatrix();
-	glUniformMatrix4fv(glGetUniformLocation(skyboxShader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-	projection = glm::perspective(glm::radians(45.0f), (float)retina_width / (float)retina_height, 0.1f, 1000.0f); 
-	glUniformMatrix4fv(glGetUniformLocation(skyboxShader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
 
 }
 
 void initObjects() {
-	blenderScene.LoadModel("objects/scene.obj");
-	lightCube.LoadModel("objects/cube/cube.obj");
-	castleBridge.LoadModel("objects/castle_bridge.obj");
-	mill.LoadModel("objects/mill.obj");
-	gate[0].LoadModel("objects/gate1.obj");
-	gate[1].LoadModel("objects/gate2.obj");
-	gate[2].LoadModel("objects/gate3.obj");
-	monument.LoadModel("objects/monument.obj");	
-	duck.LoadModel("objects/duck.obj");
-	droplet.LoadModel("objects/rain.obj");
-	river.LoadModel("objects/river.obj");
-	trees.LoadModel("objects/trees.obj");
-	for (int i = 0; i < DUCK_NO; i++) {
-		ducks[i] = duck;
+	GPS_PROFILE_FUNCTION();
+	for (sceneObject& object : sceneObjects) {
+		object.model->LoadModel(object.fileName);
 	}
-	for (int i = 0; i < DROPLET_NO; i++) {
-		droplets[i] = droplet;
+	//textures of every model are decoded in parallel, upload them all before the first frame
+	gps::Model3D::FinishTextureLoads();
+
+	//the cascades are clamped to the shadow casters
+	sceneBounds = gps::emptyBounds();
+	for (const sceneObject& object : sceneObjects) {
+		if (object.castsShadow)
+			sceneBounds = gps::mergeBounds(sceneBounds, object.model->GetBounds());
 	}
 }
 
+//one entry per object and frame, the meshes pick theirs through the draw ID attribute
+//of the arena's vertex array, instanced meshes have vertex arrays of their own without it
+bool initDrawTransforms() {
+	GPS_PROFILE_FUNCTION();
+	GLuint ringObjects = 0;
+	for (const sceneObject& object : sceneObjects) {
+		if (object.placement == RING_PLACED)
+			ringObjects++;
+	}
+	if (!drawTransforms.Init(ringObjects))
+		return false;
+	gps::GeometryArena::Get().SetDrawIDBuffer(drawTransforms.GetDrawIDBuffer());
+	return true;
+}
+
+//rebuild the binary mesh caches of the given .obj files, or of the whole scene
+int bakeMeshCaches(int fileCount, const char* fileNames[]) {
+	int failures = 0;
+	if (fileCount == 0) {
+		for (sceneObject& object : sceneObjects) {
+			if (!gps::Model3D::BakeMeshCache(object.fileName))
+				failures++;
+		}
+	}
+	for (int i = 0; i < fileCount; i++) {
+		if (!gps::Model3D::BakeMeshCache(fileNames[i]))
+			failures++;
+	}
+	return failures == 0 ? 0 : 1;
+}
+
 void initShaders() {
-	myCustomShader.loadShader("shaders/shaderStart.vert", "shaders/shaderStart.frag");
-	myCustomShader.useShaderProgram();
+	GPS_PROFILE_FUNCTION();
+	//the permutations are compiled on first use
+	myCustomShader.loadShader("shaders/shaderStart.vert", "shaders/shaderStart.frag", shaderFeatureNames);
 	lightShader.loadShader("shaders/lightCube.vert", "shaders/lightCube.frag");
 	lightShader.useShaderProgram();
-	depthMapShader.loadShader("shaders/depthMapShader.vert", "shaders/depthMapShader.frag");
-	depthMapShader.useShaderProgram();
-}
-
-void sendPointLight(int index) {
-	char tmp[5][40];
-	sprintf_s(tmp[0], 40, "pointLights[%d].position", index);
-	sprintf_s(tmp[1], 40, "pointLights[%d].constant", index);
-	sprintf_s(tmp[2], 40, "pointLights[%d].linear", index);
-	sprintf_s(tmp[3], 40, "pointLights[%d].quadratic", index);
-	sprintf_s(tmp[4], 40, "pointLights[%d].color", index);
-	myCustomShader.useShaderProgram();
-	glUniform3fv(glGetUniformLocation(myCustomShader.shaderProgram, tmp[0]), 1, glm::value_ptr(pointLights[index].position));
-	glUniform1f(glGetUniformLocation(myCustomShader.shaderProgram, tmp[1]), pointLights[index].constant);
-	glUniform1f(glGetUniformLocation(myCustomShader.shaderProgram, tmp[2]), pointLights[index].linear);
-	glUniform1f(glGetUniformLocation(myCustomShader.shaderProgram, tmp[3]), pointLights[index].quadratic);
-	glUniform3fv(glGetUniformLocation(myCustomShader.shaderProgram, tmp[4]), 1, glm::value_ptr(pointLights[index].color));
+	depthMapShader.loadShader("shaders/depthMapShader.vert", "shaders/depthMapShader.frag", shaderFeatureNames);
+	rainUpdateShader.loadFeedbackShader("shaders/rainUpdate.vert", { "particle" });
 }
 
 void initPointlights() {
-	pointLight tmp;
+	gps::PointLight tmp;
 	tmp.position = glm::vec3(-5.8837f, 3.4141f, 4.008f);
 	tmp.color = glm::vec3(0.9f, 0.35f, 0.0f);
 	tmp.constant = 1.0f;
 	tmp.linear = 0.7f;
 	tmp.quadratic = 1.8f;
-	pointLights[0] = tmp;
+	pointLights.push_back(tmp);
 	tmp.position = glm::vec3(-9.0f, 3.4141f, -3.4834f);
-	pointLights[1] = tmp;
+	pointLights.push_back(tmp);
 	tmp.position = glm::vec3(-1.7211f, 3.4141f, -6.4655f);
-	pointLights[2] = tmp;
+	pointLights.push_back(tmp);
 	tmp.position = glm::vec3(1.369f, 3.4141f, 0.8045f);
-	pointLights[3] = tmp;
+	pointLights.push_back(tmp);
 }
 
 void initSpotLight() {
@@ -693,344 +851,533 @@ void initSpotLight() {
 }
 
 void initUniforms() {
+	GPS_PROFILE_FUNCTION();
 
-	myCustomShader.useShaderProgram();
-
-	fogFactorLoc = glGetUniformLocation(myCustomShader.shaderProgram, "fogDensity");
-	glUniform1f(fogFactorLoc, fogFactor);
-
-	glUniform1f(glGetUniformLocation(myCustomShader.shaderProgram, "pointFlag") , 0.0f);
-	glUniform1f(glGetUniformLocation(myCustomShader.shaderProgram, "spotFlag"), 0.0f);
-	glUniform1f(glGetUniformLocation(myCustomShader.shaderProgram, "transparentFlag"), 0.0f);
-	glUniform1f(glGetUniformLocation(myCustomShader.shaderProgram, "reflectiveFlag"), 0.0f);
+	//view, projection, fog and lights reach the shaders through the uniform blocks
+	uniformBlocks.Init({ sizeof(FrameData), sizeof(LightData) });
 
 	model = glm::mat4(1.0f);
-	modelLoc = glGetUniformLocation(myCustomShader.shaderProgram, "model");
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
 
 	view = myCamera.getViewMatrix();
-	viewLoc = glGetUniformLocation(myCustomShader.shaderProgram, "view");
-	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-	
-	normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
-	normalMatrixLoc = glGetUniformLocation(myCustomShader.shaderProgram, "normalMatrix");
-	glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
 	
 	projection = glm::perspective(glm::radians(45.0f), (float)retina_width / (float)retina_height, 0.1f, 1000.0f);
-	projectionLoc = glGetUniformLocation(myCustomShader.shaderProgram, "projection");
-	glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
 
 	//set the light direction (direction towards the light)
 	lightDir = glm::vec3(1.1f, 1.68f, 13.61f);
 	lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(lightAngle), glm::vec3(0, 1, 0));
-	lightDirLoc = glGetUniformLocation(myCustomShader.shaderProgram, "lightDir");	
-	glUniform3fv(lightDirLoc, 1, glm::value_ptr(glm::inverseTranspose(glm::mat3(view * lightRotation)) * lightDir));
 
 	//set light color
 	lightColor = glm::vec3(1.0f, 1.0f, 1.0f); //white light
-	lightColorLoc = glGetUniformLocation(myCustomShader.shaderProgram, "lightColor");
-	glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
 
 	//set pointlights
 	initPointlights();
-	for (int i = 0; i < POINTLIGHT_NO; i++) {
-		sendPointLight(i);
-	}
+	lightClusters.Init(retina_width, retina_height, glm::radians(45.0f), 0.1f, 1000.0f, 100.0f);
 
 	//set spotlight
 	initSpotLight();
 
-	glUniform3fv(glGetUniformLocation(myCustomShader.shaderProgram, "mySpotLight.position"), 1, glm::value_ptr(mySpotLight.position));
-	glUniform3fv(glGetUniformLocation(myCustomShader.shaderProgram, "mySpotLight.direction"), 1, glm::value_ptr(mySpotLight.direction));
-	glUniform1f(glGetUniformLocation(myCustomShader.shaderProgram, "mySpotLight.cutOff"), mySpotLight.cutOff);
-	glUniform1f(glGetUniformLocation(myCustomShader.shaderProgram, "mySpotLight.outerCutOff"), mySpotLight.outerCutOff);
+	//the shadow cascades are always bound to unit 3
+	myCustomShader.setInt(uniforms::shadowMap, 3);
+}
 
-	lightShader.useShaderProgram();
-	glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+//fills both uniform blocks for this frame and sends them with a single buffer write
+void updateUniformBlocks() {
+	GPS_PROFILE_FUNCTION();
+	FrameData& frame = uniformBlocks.Block<FrameData>(FRAME_BLOCK);
+	frame.view = view;
+	frame.projection = projection;
+	frame.fogDensity = fogFactor;
+
+	LightData& light = uniformBlocks.Block<LightData>(LIGHT_BLOCK);
+	for (int i = 0; i < CASCADE_NO; i++) {
+		light.lightSpaceTrMatrices[i] = cascadeMatrices[i];
+		light.cascadeSplits[i] = cascadeSplits[i];
+	}
+	light.lightDir = glm::inverseTranspose(glm::mat3(view * lightRotation)) * lightDir;
+	light.lightColor = lightColor;
+	light.mySpotLight = mySpotLight;
+	light.clusterParams = lightClusters.GetShaderParams();
+
+	uniformBlocks.Upload();
 }
 
-void initFBO() {
-	//generate FBO ID
-	glGenFramebuffers(1, &shadowMapFBO);
-	//create depth texture for FBO 
-	glGenTextures(1, &depthMapTexture);
-	glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+//depth texture array with one framebuffer per layer
+void initDepthMap(GLuint fbo[], GLuint& texture, GLsizei width, GLsizei height) {
+	glGenTextures(1, &texture);
+	gps::GLStateCache::Get().BindTexture(0, GL_TEXTURE_2D_ARRAY, texture);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, width, height, CASCADE_NO, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-	//attach texture to FBO
-	glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMapTexture, 0);
-	glDrawBuffer(GL_NONE);
-	glReadBuffer(GL_NONE);
+	glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	gps::GLStateCache::Get().BindTexture(0, GL_TEXTURE_2D_ARRAY, 0);
+
+	//attach every layer to its own FBO
+	glGenFramebuffers(CASCADE_NO, fbo);
+	for (int i = 0; i < CASCADE_NO; i++) {
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo[i]);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, i);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-glm::mat4 computeLightSpaceTrMatrix() {
-	glm::vec3 lightDirAux = glm::mat3(glm::inverseTranspose(lightRotation)) * lightDir;
-	glm::mat4 lightView = glm::lookAt(lightDirAux, glm::vec3(0.079f, 0.57f, 10.471f), glm::vec3(0, 1, 0));
-	glm::mat4 lightProjection = glm::ortho(-10.0f, 10.0f, -1.0f, 1.0f, near_plane, far_plane);
-	glm::mat4 lightSpaceTrMatrix = lightProjection * lightView;
-	return lightSpaceTrMatrix;
+void initFBO() {
+	GPS_PROFILE_FUNCTION();
+	initDepthMap(shadowMapFBO, depthMapTexture, SHADOW_WIDTH, SHADOW_HEIGHT);
+	initDepthMap(staticCacheFBO, staticCacheTexture, STATIC_CACHE_SIZE, STATIC_CACHE_SIZE);
+	for (int i = 0; i < CASCADE_NO; i++) {
+		staticCacheValid[i] = false;
+	}
+}
+
+//moves a cascade to whole texels, so the shadow edges do not shimmer when the camera moves,
+//and builds its light space matrix
+void placeCascade(int cascade, glm::vec3 centerLight, float radius, float split) {
+	float texelSize = 2.0f * radius / SHADOW_WIDTH;
+	centerLight.x = std::floor(centerLight.x / texelSize) * texelSize;
+	centerLight.y = std::floor(centerLight.y / texelSize) * texelSize;
+
+	glm::mat4 lightProjection = glm::ortho(centerLight.x - radius, centerLight.x + radius,
+		centerLight.y - radius, centerLight.y + radius,
+		cascadeDepthRange.x, cascadeDepthRange.y);
+	cascadeMatrices[cascade] = lightProjection * cascadeLightView;
+	cascadeSplits[cascade] = split;
+	cascadeExtents[cascade] = glm::vec3(centerLight.x, centerLight.y, radius);
+}
+
+//fits the cascades around slices of the camera frustum, the last one covers the whole scene
+//needs the current view and lightRotation
+void computeCascades() {
+	GPS_PROFILE_FUNCTION();
+	const float nearClip = 0.1f;
+	const float farClip = 1000.0f;
+	float aspect = (float)retina_width / (float)retina_height;
+	float tanHalfFov = glm::tan(glm::radians(45.0f) * 0.5f);
+	glm::mat4 inverseView = glm::inverse(view);
+
+	//the light looks along -lightDir, the origin does not matter for an orthographic projection
+	glm::vec3 toLight = glm::normalize(glm::mat3(lightRotation) * lightDir);
+	glm::vec3 up = glm::abs(toLight.y) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+	glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), -toLight, up);
+	gps::AABB sceneLight = gps::transformBounds(sceneBounds, lightView);
+	glm::vec3 sceneHalf = (sceneLight.max - sceneLight.min) * 0.5f;
+	//the depth range covers every caster of the scene, also the ones outside the slices
+	cascadeLightView = lightView;
+	cascadeDepthRange = glm::vec2(-sceneLight.max.z, -sceneLight.min.z);
+
+	//the other cascades split the camera frustum up to shadowDistance
+	const int cameraCascades = CASCADE_NO - 1;
+	float sliceNear = nearClip;
+	for (int i = 0; i < cameraCascades; i++) {
+		//practical split scheme, a blend of logarithmic and uniform splits
+		float p = (i + 1) / (float)cameraCascades;
+		float logSplit = nearClip * std::pow(shadowDistance / nearClip, p);
+		float uniformSplit = nearClip + (shadowDistance - nearClip) * p;
+		float sliceFar = glm::mix(uniformSplit, logSplit, cascadeSplitLambda);
+
+		//bounding sphere of the slice, its size does not change when the camera turns
+		glm::vec3 corners[8];
+		glm::vec3 center(0.0f);
+		for (int c = 0; c < 8; c++) {
+			float depth = (c & 4) ? sliceFar : sliceNear;
+			glm::vec3 cornerEye(((c & 1) ? 1.0f : -1.0f) * depth * tanHalfFov * aspect,
+				((c & 2) ? 1.0f : -1.0f) * depth * tanHalfFov,
+				-depth);
+			corners[c] = glm::vec3(inverseView * glm::vec4(cornerEye, 1.0f));
+			center += corners[c];
+		}
+		center /= 8.0f;
+		float radius = 0.0f;
+		for (int c = 0; c < 8; c++) {
+			radius = glm::max(radius, glm::length(corners[c] - center));
+		}
+		radius = std::ceil(radius * 16.0f) / 16.0f;
+
+		//keep the cascade over the scene, or shrink it to the scene when the scene is smaller
+		glm::vec3 centerLight = glm::vec3(lightView * glm::vec4(center, 1.0f));
+		radius = glm::min(radius, glm::max(sceneHalf.x, sceneHalf.y));
+		for (int axis = 0; axis < 2; axis++) {
+			if (sceneHalf[axis] <= radius)
+				centerLight[axis] = (sceneLight.min[axis] + sceneLight.max[axis]) * 0.5f;
+			else
+				centerLight[axis] = glm::clamp(centerLight[axis], sceneLight.min[axis] + radius, sceneLight.max[axis] - radius);
+		}
+
+		placeCascade(i, centerLight, radius, sliceFar);
+		sliceNear = sliceFar;
+	}
+
+	//the last cascade covers the whole scene, with a texel of margin on every side for the snapping
+	float sceneRadius = glm::max(sceneHalf.x, sceneHalf.y) * SHADOW_WIDTH / (SHADOW_WIDTH - 2.0f);
+	sceneRadius = std::ceil(sceneRadius * 16.0f) / 16.0f;
+	placeCascade(CASCADE_NO - 1, (sceneLight.min + sceneLight.max) * 0.5f, sceneRadius, farClip);
 }
 
-void drawDuck(gps::Shader shader, bool depthPass, int duckIndex) {
-	shader.useShaderProgram();
-	glm::mat4 modelAux = model;
+glm::mat4 computeDuckTransform(int duckIndex) {
+	glm::mat4 modelAux = glm::mat4(1.0f);
 	modelAux = glm::translate(modelAux, getBezierPoint(t, curves.at(duckIndex)));
 	glm::vec3 directionVector = glm::normalize(-getBezierDirectionVector(t, curves.at(duckIndex)));
 	float bezierAngle = glm::atan(directionVector.z, directionVector.x);
 	bezierAngle = (bezierAngle * 180) / 3.14;
 	modelAux = glm::rotate(modelAux, glm::radians(270.f - bezierAngle), glm::vec3(0, 1, 0));
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(modelAux));
-	if (!depthPass) {
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * modelAux));
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(glm::mat3(glm::inverseTranspose(normalMatrix))));
-	}
-	ducks[duckIndex].Draw(shader);
+	return modelAux;
 }
 
-void drawDroplet(gps::Shader shader, bool depthPass, int dropletIndex) {
-	shader.useShaderProgram();
-	glm::mat4 modelAux = model;
-	rainDrop tmpRainDrop = rainDrops.at(dropletIndex);
-	glm::vec3 tmpPoint = tmpRainDrop.position;
-	modelAux = glm::translate(modelAux, glm::vec3(tmpPoint.x,tmpPoint.y - tmpRainDrop.moveCounter * tmpRainDrop.speed,tmpPoint.z));
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(modelAux));
-	if (!depthPass) {
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * modelAux));
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(glm::mat3(glm::inverseTranspose(normalMatrix))));
-	}
-	droplets[dropletIndex].Draw(shader);
+//rebuild the instance buffer once per frame, it is shared by the depth and color passes
+void updateInstanceTransforms() {
+	GPS_PROFILE_FUNCTION();
+	duckTransforms.resize(DUCK_NO);
+	for (int i = 0; i < DUCK_NO; i++) {
+		duckTransforms[i] = computeDuckTransform(i);
+	}
+	duck.SetInstanceTransforms(duckTransforms);
 }
 
-void drawObjects(gps::Shader shader, bool depthPass) {
-		
-	//draw Blender scene
-	shader.useShaderProgram();
-	
-	model = glm::mat4(1.0f);
-	//model = glm::rotate(glm::mat4(1.0f), glm::radians(angleY), glm::vec3(0.0f, 1.0f, 0.0f));
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+//model matrix of an object for the current animation state
+glm::mat4 computeObjectTransform(const gps::Model3D& object) {
+	glm::mat4 modelAux = glm::mat4(1.0f);
 
-	// do not send the normal matrix if we are rendering in the depth map
-	if (!depthPass) {
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+	//bridge gate
+	if (&object == &castleBridge) {
+		glm::vec3 bridgePoint = glm::vec3(-1.3194f, 0.58868f, 4.6881f);
+
+		modelAux = glm::translate(modelAux, bridgePoint);
+		modelAux = glm::rotate(modelAux, glm::radians(23.3f), glm::vec3(0, 1, 0));
+		modelAux = glm::rotate(modelAux, glm::radians(bridgeAngle), glm::vec3(1.0f, 0.0f, 0.0f));
+		modelAux = glm::rotate(modelAux, glm::radians(-23.3f), glm::vec3(0, 1, 0));
+		modelAux = glm::translate(modelAux, -bridgePoint);
 	}
-	blenderScene.Draw(shader);
 
-	//draw trees
-	glDisable(GL_CULL_FACE);
-	trees.Draw(shader);
-	glEnable(GL_CULL_FACE);
+	//mill
+	if (&object == &mill) {
+		glm::vec3 millPoint = glm::vec3(1.584f, 1.152f, 7.912f);
 
-	//draw reflective monument
-	if (!depthPass) {
-		glUniform1f(glGetUniformLocation(shader.shaderProgram, "reflectiveFlag"), 1.0f);
-	}
-	monument.Draw(shader);
-	if (!depthPass) {
-		glUniform1f(glGetUniformLocation(shader.shaderProgram, "reflectiveFlag"), 0.0f);
+		modelAux = glm::translate(modelAux, millPoint);
+		modelAux = glm::rotate(modelAux, glm::radians(millAngle), glm::vec3(0, 0, 1));
+		modelAux = glm::translate(modelAux, -millPoint);
 	}
 
-	//draw bridge gate
-	glm::mat4 modelAux = model;
-	glm::vec3 bridgePoint = glm::vec3(-1.3194f, 0.58868f, 4.6881f);
+	//gates, the first one opens the other way
+	glm::vec3 gatePoints[3] = {
+		glm::vec3(-0.134f, 0.6211f, 12.46f),
+		glm::vec3(-0.7941f, 0.6211f, 12.46f),
+		glm::vec3(-1.737f, 0.6211f, 12.46f)
+	};
+	for (int i = 0; i < 3; i++) {
+		if (&object == &gate[i]) {
+			modelAux = glm::translate(modelAux, gatePoints[i]);
+			modelAux = glm::rotate(modelAux, glm::radians(i == 0 ? -gateAngle : gateAngle), glm::vec3(0, 1, 0));
+			modelAux = glm::translate(modelAux, -gatePoints[i]);
+		}
+	}
 
-	modelAux = glm::translate(modelAux, bridgePoint);
-	modelAux = glm::rotate(modelAux, glm::radians(23.3f), glm::vec3(0, 1, 0));
-	modelAux = glm::rotate(modelAux, glm::radians(bridgeAngle), glm::vec3(1.0f, 0.0f, 0.0f));
-	modelAux = glm::rotate(modelAux, glm::radians(-23.3f), glm::vec3(0, 1, 0));
-	modelAux = glm::translate(modelAux, -bridgePoint);
+	return modelAux;
+}
 
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(modelAux));
-	if (!depthPass) {
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * modelAux));
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(glm::mat3(glm::inverseTranspose(normalMatrix))));
+//writes the matrices of every object into this frame's part of the transform ring, needs the current view
+void updateDrawTransforms() {
+	GPS_PROFILE_FUNCTION();
+	drawTransforms.BeginFrame();
+	for (int i = 0; i < SCENE_OBJECT_NO; i++) {
+		if (sceneObjects[i].placement != RING_PLACED)
+			continue;
+		objectTransform& entry = objectTransforms[i];
+		entry.transform = computeObjectTransform(*sceneObjects[i].model);
+		entry.drawID = drawTransforms.Add(entry.transform, glm::inverseTranspose(glm::mat3(view * entry.transform)));
 	}
-	castleBridge.Draw(shader);
+	drawTransforms.Bind();
+}
 
-	//draw mill 
-	modelAux = model;
-	glm::vec3 millPoint = glm::vec3(1.584f, 1.152f, 7.912f);
+//picks the permutation of the pass for an object, the render queue binds it
+gps::Shader& passShader(gps::ShaderPermutations& shaders, bool depthPass, unsigned features) {
+	if (depthPass)
+		features &= depthFeatures;
+	else
+		features |= lightFeatures;
+	return shaders.Get(features);
+}
 
-	modelAux = glm::translate(modelAux, millPoint);
-	modelAux = glm::rotate(modelAux, glm::radians(millAngle), glm::vec3(0, 0, 1));
-	modelAux = glm::translate(modelAux, -millPoint);
-	
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(modelAux));
-	if (!depthPass) {
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * modelAux));
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(glm::mat3(glm::inverseTranspose(normalMatrix))));
+//queues the object if it belongs to the drawn set, objects that cast no shadow are left out of the depth pass
+void submitObject(gps::Model3D& object, gps::ShaderPermutations& shaders, bool depthPass, unsigned features,
+	unsigned state, const gps::Frustum& frustum, int objects) {
+	//no color is written in the depth pass, so nothing there needs blending or back to front order
+	if (depthPass)
+		state &= ~gps::RenderQueue::TRANSLUCENT;
+
+	for (int i = 0; i < SCENE_OBJECT_NO; i++) {
+		const sceneObject& entry = sceneObjects[i];
+		if (entry.model != &object)
+			continue;
+		if ((entry.set & objects) == 0 || (depthPass && !entry.castsShadow))
+			return;
+
+		gps::Shader& shader = passShader(shaders, depthPass, features);
+		const objectTransform& placed = objectTransforms[i];
+		if (entry.placement == INSTANCE_PLACED)
+			object.SubmitInstanced(renderQueue, shader, frustum, state);
+		else if (placed.drawID != gps::TransformRing::INVALID_DRAW)
+			object.Submit(renderQueue, shader, frustum, placed.transform, placed.drawID, state);
+		return;
 	}
-	glDisable(GL_CULL_FACE);
-	mill.Draw(shader);
-	glEnable(GL_CULL_FACE);
-	//draw gates
-	modelAux = model;
-	glm::vec3 gate0Point = glm::vec3(-0.134f, 0.6211f, 12.46f);
+}
 
-	modelAux = glm::translate(modelAux, gate0Point);
-	modelAux = glm::rotate(modelAux, glm::radians(-gateAngle), glm::vec3(0, 1, 0));
-	modelAux = glm::translate(modelAux, -gate0Point);
+//objects outside the frustum of the pass are skipped, the render queue decides the draw order
+void drawObjects(gps::ShaderPermutations& shaders, bool depthPass, const glm::mat4& viewProjection, int objects) {
+	GPS_PROFILE_FUNCTION();
+	gps::Frustum frustum(viewProjection);
+	//the depth shader samples no textures, the shadow pass merges across materials
+	renderQueue.Begin(depthPass ? SHADOW_PASS : COLOR_PASS, viewProjection, !depthPass);
 
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(modelAux));
-	if (!depthPass) {
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * modelAux));
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(glm::mat3(glm::inverseTranspose(normalMatrix))));
-	}
-	gate[0].Draw(shader);
+	//Blender scene
+	submitObject(blenderScene, shaders, depthPass, 0, 0, frustum, objects);
 
-	modelAux = model;
-	glm::vec3 gate1Point = glm::vec3(-0.7941f, 0.6211f, 12.46f);
+	//trees, seen from both sides
+	submitObject(trees, shaders, depthPass, 0, gps::RenderQueue::DOUBLE_SIDED, frustum, objects);
 
-	modelAux = glm::translate(modelAux, gate1Point);
-	modelAux = glm::rotate(modelAux, glm::radians(gateAngle), glm::vec3(0, 1, 0));
-	modelAux = glm::translate(modelAux, -gate1Point);
+	//reflective monument
+	submitObject(monument, shaders, depthPass, FEATURE_REFLECTIVE, 0, frustum, objects);
 
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(modelAux));
-	if (!depthPass) {
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * modelAux));
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(glm::mat3(glm::inverseTranspose(normalMatrix))));
-	}
-	gate[1].Draw(shader);
+	//bridge gate
+	submitObject(castleBridge, shaders, depthPass, 0, 0, frustum, objects);
 
-	modelAux = model;
-	glm::vec3 gate2Point = glm::vec3(-1.737f, 0.6211f, 12.46f);
+	//mill, seen from both sides
+	submitObject(mill, shaders, depthPass, 0, gps::RenderQueue::DOUBLE_SIDED, frustum, objects);
 
-	modelAux = glm::translate(modelAux, gate2Point);
-	modelAux = glm::rotate(modelAux, glm::radians(gateAngle), glm::vec3(0, 1, 0));
-	modelAux = glm::translate(modelAux, -gate2Point);
+	//gates
+	for (int i = 0; i < 3; i++)
+		submitObject(gate[i], shaders, depthPass, 0, 0, frustum, objects);
 
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(modelAux));
-	if (!depthPass) {
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * modelAux));
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(glm::mat3(glm::inverseTranspose(normalMatrix))));
-	}
-	gate[2].Draw(shader);
-	
-	//draw ducks
-	for (int i = 0; i < DUCK_NO; i++) {
-		drawDuck(shader, depthPass, i);
-	}
+	//ducks
+	submitObject(duck, shaders, depthPass, FEATURE_INSTANCED, 0, frustum, objects);
 
-	//DRAW TRANSPARENT OBJS
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	if (!depthPass) {
-		glUniform1f(glGetUniformLocation(shader.shaderProgram, "transparentFlag"), 1.0f);
-	}
+	//transparent objects, drawn after the opaque ones from back to front
+	submitObject(river, shaders, depthPass, FEATURE_TRANSPARENT, gps::RenderQueue::TRANSLUCENT, frustum, objects);
 
-	//draw river
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+	//rain, the droplet positions come straight from the particle buffer
+	submitObject(droplet, shaders, depthPass, FEATURE_PARTICLE | FEATURE_TRANSPARENT, gps::RenderQueue::TRANSLUCENT, frustum, objects);
 
-	if (!depthPass) {
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-		glUniformMatrix3fv(glGetUniformLocation(shader.shaderProgram, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(normalMatrix));
-	}
-	river.Draw(shader);
+	renderQueue.Execute();
+}
 
-	//draw rain
-	for (int i = 0; i < DROPLET_NO; i++) {
-		drawDroplet(shader, depthPass, i);
+//one row per pass with the counters of the last frame, and their totals
+void drawStatsOverlay() {
+	gps::RenderStats& stats = gps::RenderStats::Get();
+	const char* format = "%-8s %6s %9s %9s %5s %5s %5s %9s %6s";
+	int lineHeight = gps::TextOverlay::CELL_HEIGHT * statsOverlay.GetScale();
+	int y = 10;
+	char line[128];
+
+	snprintf(line, sizeof(line), format, "pass", "draws", "tris", "verts", "progs", "texs", "unifs", "bytes", "culled");
+	statsOverlay.AddText(10, y, line, glm::vec3(1.0f, 0.85f, 0.3f));
+
+	for (int pass = gps::RenderStats::ALL_PASSES; pass < stats.GetPassCount(); pass++) {
+		std::string values[gps::RenderStats::COUNTER_COUNT];
+		for (int i = 0; i < gps::RenderStats::COUNTER_COUNT; i++) {
+			values[i] = std::to_string(stats.GetLast((gps::RenderStats::Counter)i, pass));
+		}
+		const char* name = pass == gps::RenderStats::ALL_PASSES ? "total" : stats.GetPassName(pass).c_str();
+		snprintf(line, sizeof(line), format, name, values[0].c_str(), values[1].c_str(), values[2].c_str(), values[3].c_str(),
+			values[4].c_str(), values[5].c_str(), values[6].c_str(), values[7].c_str());
+		y += lineHeight;
+		statsOverlay.AddText(10, y, line);
 	}
-	if (!depthPass) {
-		glUniform1f(glGetUniformLocation(shader.shaderProgram, "transparentFlag"), 0.0f);
+
+	statsOverlay.Draw(retina_width, retina_height);
+}
+
+//light space matrix of the static cache of a cascade, centered on center
+glm::mat4 staticCacheMatrix(int cascade, const glm::vec2& center) {
+	float extent = cascadeExtents[cascade].z * STATIC_CACHE_SIZE / SHADOW_WIDTH;
+	return glm::ortho(center.x - extent, center.x + extent, center.y - extent, center.y + extent,
+		cascadeDepthRange.x, cascadeDepthRange.y) * cascadeLightView;
+}
+
+//copies the static casters of a cascade out of its cache, the cache is redrawn first
+//when the cascade moved out of it or the light moved
+void drawStaticShadow(int cascade) {
+	//the cache and the cascade share the texel grid, so the cascade starts at a whole texel of the cache
+	const int padding = (STATIC_CACHE_SIZE - SHADOW_WIDTH) / 2;
+	glm::vec3 extent = cascadeExtents[cascade];
+	float texelSize = 2.0f * extent.z / SHADOW_WIDTH;
+	glm::vec2& cacheCenter = staticCacheCenters[cascade];
+	int offsetX = padding + (int)std::lround((extent.x - cacheCenter.x) / texelSize);
+	int offsetY = padding + (int)std::lround((extent.y - cacheCenter.y) / texelSize);
+
+	bool outside = offsetX < 0 || offsetX > 2 * padding || offsetY < 0 || offsetY > 2 * padding;
+	if (!staticCacheValid[cascade] || outside || staticCacheMatrix(cascade, cacheCenter) != staticCacheMatrices[cascade]) {
+		cacheCenter = glm::vec2(extent.x, extent.y);
+		staticCacheMatrices[cascade] = staticCacheMatrix(cascade, cacheCenter);
+		staticCacheValid[cascade] = true;
+		offsetX = padding;
+		offsetY = padding;
+
+		glViewport(0, 0, STATIC_CACHE_SIZE, STATIC_CACHE_SIZE);
+		glBindFramebuffer(GL_FRAMEBUFFER, staticCacheFBO[cascade]);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		depthMapShader.setMat4(uniforms::lightSpaceTrMatrix, staticCacheMatrices[cascade]);
+		drawObjects(depthMapShader, true, staticCacheMatrices[cascade], STATIC_OBJECTS);
+		glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
 	}
-	glDisable(GL_BLEND);
- }
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, staticCacheFBO[cascade]);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadowMapFBO[cascade]);
+	glBlitFramebuffer(offsetX, offsetY, offsetX + SHADOW_WIDTH, offsetY + SHADOW_HEIGHT,
+		0, 0, SHADOW_WIDTH, SHADOW_HEIGHT, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+}
 
 void renderScene() {
+	GPS_PROFILE_FUNCTION();
 
-	//render the scene in the depth map
-	depthMapShader.useShaderProgram();
-	glUniformMatrix4fv(glGetUniformLocation(depthMapShader.shaderProgram, "lightSpaceTrMatrix"),
-		1,
-		GL_FALSE,
-		glm::value_ptr(computeLightSpaceTrMatrix()));
+	updateInstanceTransforms();
 
-	glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-	glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-	glClear(GL_DEPTH_BUFFER_BIT);
-	drawObjects(depthMapShader, true);
+	view = myCamera.getViewMatrix();
+	projection = glm::perspective(glm::radians(45.0f), (float)retina_width / (float)retina_height, 0.1f, 1000.0f);
+	lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(lightAngle), glm::vec3(0, 1, 0));
+	computeCascades();
+	updateUniformBlocks();
+	updateDrawTransforms();
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	//render the scene in the depth map, one layer per cascade
+	gps::GpuProfiler::Get().BeginScope("shadow");
+	gps::RenderStats::Get().BeginPass("shadow");
+	glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
 
-	glViewport(0, 0, retina_width, retina_height);
+	for (int i = 0; i < CASCADE_NO; i++) {
+		//start from the cached static depth and add the moving casters on top
+		drawStaticShadow(i);
+		glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO[i]);
+		depthMapShader.setMat4(uniforms::lightSpaceTrMatrix, cascadeMatrices[i]);
+		drawObjects(depthMapShader, true, cascadeMatrices[i], DYNAMIC_OBJECTS);
+	}
 
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	gps::GpuProfiler::Get().EndScope();
 
-	myCustomShader.useShaderProgram();
+	gps::RenderStats::Get().BeginPass("forward");
+	glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
 
-	view = myCamera.getViewMatrix();
-	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-	
-	lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(lightAngle), glm::vec3(0, 1, 0));
-	glUniform3fv(lightDirLoc, 1, glm::value_ptr(glm::inverseTranspose(glm::mat3(view * lightRotation)) * lightDir));
+	glViewport(0, 0, retina_width, retina_height);
 
-	//bind the shadow map
-	glActiveTexture(GL_TEXTURE3);
-	glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-	glUniform1i(glGetUniformLocation(myCustomShader.shaderProgram, "shadowMap"), 3);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	glUniformMatrix4fv(glGetUniformLocation(myCustomShader.shaderProgram, "lightSpaceTrMatrix"),
-		1,
-		GL_FALSE,
-		glm::value_ptr(computeLightSpaceTrMatrix()));
+	//bind the shadow cascades
+	gps::GLStateCache::Get().BindTexture(3, GL_TEXTURE_2D_ARRAY, depthMapTexture);
 
-	fogFactorLoc = glGetUniformLocation(myCustomShader.shaderProgram, "fogDensity");
-	glUniform1f(fogFactorLoc, fogFactor);
+	//assign the point lights to the froxels of this view
+	lightClusters.Update(pointLights, view);
+	lightClusters.Bind();
 
-	drawObjects(myCustomShader, false);
+	gps::GpuProfiler::Get().BeginScope("forward");
+	drawObjects(myCustomShader, false, projection * view, ALL_OBJECTS);
+	gps::GpuProfiler::Get().EndScope();
 
 	//draw a white cube around the light
+	gps::GpuProfiler::Get().BeginScope("light cube");
 	lightShader.useShaderProgram();
 
-	glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-
 	model = lightRotation;
 	model = glm::translate(model, 1.0f * lightDir);
 	model = glm::scale(model, glm::vec3(0.05f, 0.05f, 0.05f));
-	glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+	lightShader.setMat4(uniforms::model, model);
 
 	lightCube.Draw(lightShader);
+	gps::GpuProfiler::Get().EndScope();
 
 	//draw skybox
-	skyboxShader.useShaderProgram();
-	view = myCamera.getViewMatrix();
-	glUniformMatrix4fv(glGetUniformLocation(skyboxShader.shaderProgram, "view"), 1, GL_FALSE,
-		glm::value_ptr(view));
-
-	projection = glm::perspective(glm::radians(45.0f), (float)retina_width / (float)retina_height, 0.1f, 1000.0f);
-	glUniformMatrix4fv(glGetUniformLocation(skyboxShader.shaderProgram, "projection"), 1, GL_FALSE,
-		glm::value_ptr(projection));
+	gps::GpuProfiler::Get().BeginScope("skybox");
+	mySkyBox.Draw(skyboxShader);
+	gps::GpuProfiler::Get().EndScope();
+
+	if (showStats) {
+		gps::GpuProfiler::Get().BeginScope("overlay");
+		gps::RenderStats::Get().BeginPass("overlay");
+		drawStatsOverlay();
+		gps::GpuProfiler::Get().EndScope();
+	}
 
-	mySkyBox.Draw(skyboxShader, view, projection);
-	
+	//the transforms of this frame can be overwritten once the GPU is past this point
+	drawTransforms.EndFrame();
 }
 
 void cleanup() {
 	glDeleteTextures(1,& depthMapTexture);
+	glDeleteTextures(1, &staticCacheTexture);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glDeleteFramebuffers(1, &shadowMapFBO);
+	glDeleteFramebuffers(CASCADE_NO, shadowMapFBO);
+	glDeleteFramebuffers(CASCADE_NO, staticCacheFBO);
+	if (headless) {
+		headlessContext.Destroy();
+		return;
+	}
 	glfwDestroyWindow(glWindow);
 	//close GL context and any other GLFW resources
 	glfwTerminate();
 }
 
 int main(int argc, const char * argv[]) {
+	GPS_PROFILE_THREAD("main");
+
+	//Lab09PG_Good --bake-meshes [file.obj ...] pre-builds the mesh caches and exits
+	if (argc > 1 && strcmp(argv[1], "--bake-meshes") == 0) {
+		return bakeMeshCaches(argc - 2, argv + 2);
+	}
+
+	//Lab09PG_Good [--headless [width height frames]] [--benchmark report [--baseline report.json] [--threshold percent]]
+	//--headless renders a fixed number of frames offscreen and exits
+	//--benchmark replays cameraLog.txt once, writes report.json/report.csv and fails on a regression over the baseline
+	int headlessWidth = glWindowWidth;
+	int headlessHeight = glWindowHeight;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--headless") == 0) {
+			headless = true;
+			if (i + 2 < argc && atoi(argv[i + 1]) > 0) {
+				headlessWidth = atoi(argv[++i]);
+				headlessHeight = atoi(argv[++i]);
+				if (i + 1 < argc && atoi(argv[i + 1]) > 0) {
+					headlessFrames = atoi(argv[++i]);
+				}
+			}
+		}
+		else if (strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc) {
+			benchmarking = true;
+			benchmarkReport = argv[++i];
+		}
+		else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+			benchmarkBaseline = argv[++i];
+		}
+		else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+			benchmarkThreshold = atof(argv[++i]);
+		}
+		else {
+			fprintf(stderr, "ERROR: unknown argument %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	if (benchmarking) {
+		simulationSeed = 1;
+		startRain = true;
+	}
+	randomEngine.seed(simulationSeed);
 
-	if (!initOpenGLWindow()) {
+	if (headless) {
+		if (!initHeadlessContext(headlessWidth, headlessHeight)) {
+			return 1;
+		}
+	}
+	else if (!initOpenGLWindow()) {
 		glfwTerminate();
 		return 1;
 	}
 	initOpenGLState();
 	initObjects();
+	if (!initDrawTransforms()) {
+		cleanup();
+		return 1;
+	}
 	initShaders();
 	initUniforms();
 	initFBO();
@@ -1044,13 +1391,44 @@ int main(int argc, const char * argv[]) {
 	FILE* pf = fopen("cameraLog.txt", "r");
 	if (pf == NULL) {
 		puts("Error Opening File!");
+		if (benchmarking) {
+			cleanup();
+			return 1;
+		}
+	}
+	if (benchmarking) {
+		benchmark.Init();
 	}
-	while (!glfwWindowShouldClose(glWindow)) {
+	gps::GpuProfiler::Get().Init();
+	statsOverlay.Init();
+	//a surfaceless context has no default framebuffer, the draws before the first pass (the rain update)
+	//still need a complete one bound
+	glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+	int frame = 0;
+	double frameTimeTotal = 0.0;
+	bool benchmarkCompleted = false;
+	//the benchmark ends with the camera path, headless runs after a fixed number of frames
+	//closing the window aborts a windowed benchmark
+	while (headless ? (benchmarking || frame < headlessFrames) : !glfwWindowShouldClose(glWindow)) {
+		GPS_PROFILE_SCOPE("frame");
+
+		//the benchmark camera steps first, so the tick the path runs out is not recorded
+		if (benchmarking && !myCamera.preview(true, pf)) {
+			benchmarkCompleted = true;
+			break;
+		}
+
+		std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+		if (benchmarking) {
+			benchmark.BeginFrame();
+		}
+		gps::GpuProfiler::Get().BeginFrame();
+		gps::RenderStats::Get().BeginFrame();
 		processMovement();
 
-		//animation handling
+		//animation handling, a fixed step per frame while benchmarking
 		end = clock();
-		if ((end - start)  > interval) {
+		if (benchmarking || (end - start)  > interval) {
 			//rain
 			if (startRain) {
 				rainMovement();
@@ -1060,15 +1438,59 @@ int main(int argc, const char * argv[]) {
 			//mill
 			millAngle += 4.0f;
 			//camera
-			myCamera.preview(cameraPreview, pf);
+			if (!benchmarking) {
+				myCamera.preview(cameraPreview, pf);
+			}
 			start = end;
 		}
 		renderScene();
-		glfwPollEvents();
-		glfwSwapBuffers(glWindow);
+		gps::GpuProfiler::Get().EndFrame();
+		if (benchmarking) {
+			gps::RenderStats& stats = gps::RenderStats::Get();
+			benchmark.EndFrame(stats.GetCurrent(gps::RenderStats::DRAW_CALLS), stats.GetCurrent(gps::RenderStats::TRIANGLES),
+				stats.GetCurrent(gps::RenderStats::STATE_CALLS), stats.GetCurrent(gps::RenderStats::ELIDED_STATE_CALLS));
+		}
+		if (headless) {
+			//nothing is presented, wait for the GPU so the frame time covers the whole frame
+			glFinish();
+		}
+		else {
+			glfwPollEvents();
+			glfwSwapBuffers(glWindow);
+		}
 		glCheckError();
+
+		frameTimeTotal += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+		frame++;
+	}
+	if (headless && frame > 0) {
+		printf("%d frames, %.3f ms per frame\n", frame, frameTimeTotal / frame);
+	}
+	if (headless || benchmarking) {
+		gps::GpuProfiler::Get().Print(stdout);
+	}
+	GPS_PROFILE_WRITE("trace.json");
+
+	int result = 0;
+	if (benchmarking && !benchmarkCompleted) {
+		fprintf(stderr, "ERROR: the benchmark was aborted before the end of the camera path\n");
+		result = 1;
+	}
+	else if (benchmarking) {
+		benchmark.Finish();
+		gps::MetricSummary cpu = benchmark.Summarize("cpu_ms");
+		gps::MetricSummary gpu = benchmark.Summarize("gpu_ms");
+		printf("%d frames, cpu %.3f ms (p95 %.3f), gpu %.3f ms (p95 %.3f)\n", (int)benchmark.GetFrameCount(), cpu.mean, cpu.p95, gpu.mean, gpu.p95);
+		if (!benchmark.WriteReport(benchmarkReport)) {
+			result = 1;
+		}
+		if (!benchmarkBaseline.empty() && !benchmark.CompareWithBaseline(benchmarkBaseline, benchmarkThreshold)) {
+			result = 1;
+		}
 	}
 	cleanup();
-	fclose(pf);
-	return 0;
+	if (pf != NULL) {
+		fclose(pf);
+	}
+	return result;
 }
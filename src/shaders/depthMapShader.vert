@@ -1,10 +1,28 @@
-#version 410 core
+#version 430 core
 
 layout(location=0) in vec3 vPosition;
+layout(location=3) in mat4 vInstanceModel;
+layout(location=7) in vec4 vParticle;
+layout(location=8) in uint vDrawID;
 
 uniform mat4 lightSpaceTrMatrix;
-uniform mat4 model;
+//mirrors gps::TransformRing::DrawTransform, only the model matrix is needed here
+struct DrawTransform {
+	mat4 model;
+	mat4 normalMatrix;
+};
+layout(std430, binding = 3) readonly buffer DrawTransforms {
+	DrawTransform drawTransforms[];
+};
 
 void main(){
-	gl_Position = lightSpaceTrMatrix* model * vec4(vPosition, 1.0f);
+#if defined(INSTANCED)
+	mat4 modelMatrix = vInstanceModel;
+#elif defined(PARTICLE)
+	mat4 modelMatrix = mat4(1.0f);
+	modelMatrix[3] = vec4(vParticle.xyz, 1.0f);
+#else
+	mat4 modelMatrix = drawTransforms[vDrawID].model;
+#endif
+	gl_Position = lightSpaceTrMatrix* modelMatrix * vec4(vPosition, 1.0f);
 }
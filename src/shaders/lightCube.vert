@@ -1,12 +1,16 @@
-#version 410 core
+#version 430 core
 
 layout(location=0) in vec3 vPosition;
 layout(location=1) in vec3 vNormal;
 layout(location=2) in vec2 vTexCoords;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+//per-frame data shared by every program, mirrors FrameData in main.cpp
+layout(std140, binding = 0) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	float fogDensity;
+};
 
 void main() 
 {
@@ -0,0 +1,37 @@
+#version 410 core
+
+layout(location=0) in vec4 vParticle;
+
+//xyz - position, w - fall speed
+out vec4 particle;
+
+uniform vec3 rainMin;
+uniform vec3 rainMax;
+uniform vec2 speedRange;
+uniform uint seed;
+
+//integer hash mapped to [0, 1)
+float random(uint n)
+{
+	n = (n ^ 61u) ^ (n >> 16u);
+	n *= 9u;
+	n = n ^ (n >> 4u);
+	n *= 0x27d4eb2du;
+	n = n ^ (n >> 15u);
+	return float(n) / 4294967296.0f;
+}
+
+void main()
+{
+	particle = vParticle;
+	particle.y -= particle.w;
+
+	//respawn the droplet somewhere in the rain volume once it hits the ground
+	if (particle.y < 0.0f) {
+		uint n = uint(gl_VertexID) * 4u + seed * 1664525u;
+		particle.x = mix(rainMin.x, rainMax.x, random(n));
+		particle.y = mix(rainMin.y, rainMax.y, random(n + 1u));
+		particle.z = mix(rainMin.z, rainMax.z, random(n + 2u));
+		particle.w = mix(speedRange.x, speedRange.y, random(n + 3u));
+	}
+}
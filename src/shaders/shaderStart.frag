@@ -1,47 +1,72 @@
-#version 410 core
-#define POINTLIGHT_NO 4
+#version 430 core
+//froxel grid, has to match gps::LightClusters
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CASCADE_NO 3
 
 in vec3 fNormal;
 in vec4 fPosEye;
 in vec2 fTexCoords;
-in vec4 fragPosLightSpace;
 in vec4 fPos;
 
 out vec4 fColor;
 
-struct pointLight {    
-    vec3 position;
-    float constant;
-    float linear;
-    float quadratic;  
-	vec3 color;
-};  
+struct pointLight {
+	vec4 positionRadius;
+	vec4 color;
+	vec4 attenuation; //constant, linear, quadratic
+};
+
+struct clusterRange {
+	uint offset;
+	uint count;
+};
 
 struct spotLight{
 	vec3 position;
-	vec3 direction;
 	float cutOff;
+	vec3 direction;
 	float outerCutOff;
 };
 
-uniform pointLight pointLights[POINTLIGHT_NO];
-uniform spotLight mySpotLight;
+//per-frame data shared by every program, mirrors FrameData and LightData in main.cpp
+layout(std140, binding = 0) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	float fogDensity;
+};
+layout(std140, binding = 1) uniform LightData {
+	//shadow cascades, cascade i covers the eye space depths up to cascadeSplits[i]
+	mat4 lightSpaceTrMatrices[CASCADE_NO];
+	vec4 cascadeSplits;
+	//directional light, towards the light in eye space
+	vec3 lightDir;
+	vec3 lightColor;
+	spotLight mySpotLight;
+	//froxel tile size in pixels, depth slice scale and bias
+	vec4 clusterParams;
+};
+
+//every point light, the lights of each froxel and the list they index into
+layout(std430, binding = 0) readonly buffer PointLights {
+	pointLight pointLights[];
+};
+layout(std430, binding = 1) readonly buffer Clusters {
+	clusterRange clusters[];
+};
+layout(std430, binding = 2) readonly buffer LightIndices {
+	uint lightIndices[];
+};
 
 //lighting
-uniform	vec3 lightDir;
-uniform	vec3 lightColor;
 uniform vec3 lightPosEye;
 
 //texture
 uniform sampler2D diffuseTexture;
 uniform sampler2D specularTexture;
-uniform sampler2D shadowMap;
+uniform sampler2DArray shadowMap;
 uniform samplerCube skybox;
-uniform float fogDensity;
-uniform float reflectiveFlag;
-uniform float transparentFlag;
-uniform float pointFlag;
-uniform float spotFlag;
 
 vec3 ambient;
 vec3 diffuse;
@@ -93,19 +118,20 @@ void computeLightComponents()
 vec3 computePointLight(pointLight light){
 	vec3 cameraPosEye = vec3(0.0f);
 	vec3 normalEye = normalize(fNormal);
-	vec3 lightDirN = normalize(light.position - fPos.xyz);
+	vec3 lightPosition = light.positionRadius.xyz;
+	vec3 lightDirN = normalize(lightPosition - fPos.xyz);
 	vec3 viewDirN = normalize(cameraPosEye - fPosEye.xyz);
 	
-	vec3 ambientAux = ambientPointStrength * light.color;
-	vec3 diffuseAux = max(dot(normalEye, lightDirN), 0.0f) * light.color;
+	vec3 ambientAux = ambientPointStrength * light.color.rgb;
+	vec3 diffuseAux = max(dot(normalEye, lightDirN), 0.0f) * light.color.rgb;
 	
 	vec3 reflection = reflect(-lightDirN, normalEye);
 	float specCoeff = pow(max(dot(viewDirN, reflection), 0.0f), shininess);
 	
-	vec3 specularAux = specularPointStrength * specCoeff * light.color;
+	vec3 specularAux = specularPointStrength * specCoeff * light.color.rgb;
 	
-	float dist = length(light.position - fPos.xyz);
-	float att = 1.0f / (light.constant + light.linear * dist + light.quadratic * dist * dist);
+	float dist = length(lightPosition - fPos.xyz);
+	float att = 1.0f / (light.attenuation.x + light.attenuation.y * dist + light.attenuation.z * dist * dist);
 	ambientAux *= att * texture(diffuseTexture, fTexCoords).rgb;
 	diffuseAux *= att * texture(diffuseTexture, fTexCoords).rgb;
 	specular *= att * texture(specularTexture, fTexCoords).rgb;
@@ -128,8 +154,32 @@ vec3 computeSpotLight(){
 	
 }
 
+//only the lights binned into the froxel of this fragment
+vec3 computePointLights()
+{
+	uvec2 tile = min(uvec2(gl_FragCoord.xy / clusterParams.xy), uvec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+	int slice = int(floor(log(max(-fPosEye.z, 1e-4f)) * clusterParams.z + clusterParams.w));
+	uint z = uint(clamp(slice, 0, CLUSTER_Z - 1));
+	clusterRange range = clusters[(z * CLUSTER_Y + tile.y) * CLUSTER_X + tile.x];
+
+	vec3 color = vec3(0.0f);
+	for (uint i = range.offset; i < range.offset + range.count; i++)
+		color += computePointLight(pointLights[lightIndices[i]]);
+	return color;
+}
+
 float computeShadow()
 {
+	//pick the first cascade that reaches the fragment
+	float depthEye = -fPosEye.z;
+	int cascade = 0;
+	while (cascade < CASCADE_NO && depthEye > cascadeSplits[cascade])
+		cascade++;
+	if (cascade == CASCADE_NO)
+		return 0.0f;
+
+	vec4 fragPosLightSpace = lightSpaceTrMatrices[cascade] * fPos;
+
 	//perform perspective divide
 	vec3 normalizedCoords= fragPosLightSpace.xyz / fragPosLightSpace.w;
 
@@ -137,7 +187,7 @@ float computeShadow()
 	normalizedCoords = normalizedCoords * 0.5 + 0.5;
 
 	//Get closest depth value from light's perspective
-	float closestDepth = texture(shadowMap, normalizedCoords.xy).r;
+	float closestDepth = texture(shadowMap, vec3(normalizedCoords.xy, cascade)).r;
 
 	//Get depth of current fragment from lights perspective
 	float currentDepth = normalizedCoords.z;
@@ -157,43 +207,46 @@ float computeFog()
 }
 
 
+//INSTANCED, PARTICLE, REFLECTIVE, TRANSPARENT, POINT_LIGHTS and SPOT_LIGHT are
+//#defined by the program permutation, the branches of the missing ones are not compiled
 void main() 
 {
+	vec4 colorFromTexture = texture(diffuseTexture,fTexCoords);
+    	if (colorFromTexture.a < 0.5)
+		discard;
+
+#ifdef REFLECTIVE
+	//the reflection replaces the lit color
+	vec3 viewDirectionN = normalize(fPosEye.xyz); 
+	vec3 normalN = normalize(fNormal); 
+	vec3 reflection = reflect(viewDirectionN, normalN); 
+	vec3 color = vec3(texture(skybox, reflection));
+#else
 	computeLightComponents();
 	
-	vec3 baseColor = vec3(0.9f, 0.35f, 0.0f);//orange
-	
-	ambient *= texture(diffuseTexture, fTexCoords).rgb;
-	diffuse *= texture(diffuseTexture, fTexCoords).rgb;
+	ambient *= colorFromTexture.rgb;
+	diffuse *= colorFromTexture.rgb;
 	specular *= texture(specularTexture, fTexCoords).rgb;
 
 	float shadow = computeShadow();
 	vec3 color = min((ambient + (1.0f - shadow) * diffuse) + (1.0f - shadow) * specular, 1.0f);
 
-	if (pointFlag == 1.0f){	
-		for(int i = 0; i<POINTLIGHT_NO;i++)
-			color += computePointLight(pointLights[i]);
-	}
-	
-	if (spotFlag == 1.0f){
-		color+=computeSpotLight();
-	}
+#ifdef POINT_LIGHTS
+	color += computePointLights();
+#endif
+
+#ifdef SPOT_LIGHT
+	color+=computeSpotLight();
+#endif
+#endif
 
-	vec4 colorFromTexture = texture(diffuseTexture,fTexCoords);
-    	if (colorFromTexture.a < 0.5)
-		discard;
 	float fogFactor = computeFog();
 	vec4 fogColor = vec4(0.5f, 0.5f, 0.5f, 1.0f);
-	
-	if(reflectiveFlag == 1.0f){
-		vec3 viewDirectionN = normalize(fPosEye.xyz); 
-		vec3 normalN = normalize(fNormal); 
-		vec3 reflection = reflect(viewDirectionN, normalN); 
-		color = vec3(texture(skybox, reflection));
-	}
 
+#ifdef TRANSPARENT
+	float alpha = 0.6;
+#else
 	float alpha = 1.0f;
-	if(transparentFlag == 1.0f)
-		alpha = 0.6;
+#endif
 	fColor = fogColor * (1-fogFactor) + vec4(color, alpha)* fogFactor;
 }
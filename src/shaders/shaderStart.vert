@@ -1,28 +1,52 @@
-#version 410 core
+#version 430 core
 
 layout(location=0) in vec3 vPosition;
 layout(location=1) in vec3 vNormal;
 layout(location=2) in vec2 vTexCoords;
+layout(location=3) in mat4 vInstanceModel;
+layout(location=7) in vec4 vParticle;
+layout(location=8) in uint vDrawID;
 
 out vec3 fNormal;
 out vec4 fPosEye;
 out vec2 fTexCoords;
-out vec4 fragPosLightSpace;
 out vec4 fPos;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform	mat3 normalMatrix;
-uniform mat4 lightSpaceTrMatrix;
+//per-frame data shared by every program, mirrors FrameData in main.cpp
+layout(std140, binding = 0) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	float fogDensity;
+};
+//model and normal matrix of every draw of the frame, mirrors gps::TransformRing::DrawTransform
+struct DrawTransform {
+	mat4 model;
+	mat4 normalMatrix;
+};
+layout(std430, binding = 3) readonly buffer DrawTransforms {
+	DrawTransform drawTransforms[];
+};
 
 void main() 
 {
+#if defined(INSTANCED)
+	//instances only use rigid transforms, so the upper 3x3 needs no inverse transpose
+	mat4 modelMatrix = vInstanceModel;
+	mat3 normalMatrixAux = mat3(view * vInstanceModel);
+#elif defined(PARTICLE)
+	//particles are only translated
+	mat4 modelMatrix = mat4(1.0f);
+	modelMatrix[3] = vec4(vParticle.xyz, 1.0f);
+	mat3 normalMatrixAux = mat3(view);
+#else
+	mat4 modelMatrix = drawTransforms[vDrawID].model;
+	mat3 normalMatrixAux = mat3(drawTransforms[vDrawID].normalMatrix);
+#endif
+
 	//compute eye space coordinates
-	fPosEye = view * model * vec4(vPosition, 1.0f);
-	fNormal = normalize(normalMatrix * vNormal);
+	fPosEye = view * modelMatrix * vec4(vPosition, 1.0f);
+	fNormal = normalize(normalMatrixAux * vNormal);
 	fTexCoords = vTexCoords;
-	fragPosLightSpace = lightSpaceTrMatrix * model * vec4(vPosition, 1.0f);
-	fPos = model * vec4(vPosition, 1.0f);
-	gl_Position = projection * view * model * vec4(vPosition, 1.0f);
+	fPos = modelMatrix * vec4(vPosition, 1.0f);
+	gl_Position = projection * view * modelMatrix * vec4(vPosition, 1.0f);
 }
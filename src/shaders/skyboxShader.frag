@@ -1,4 +1,4 @@
-#version 410 core
+#version 430 core
 
 in vec3 textureCoordinates;
 out vec4 color;
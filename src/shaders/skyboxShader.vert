@@ -1,15 +1,19 @@
-#version 410 core
+#version 430 core
 
 layout (location = 0) in vec3 vertexPosition;
 out vec3 textureCoordinates;
 
-uniform mat4 projection;
-uniform mat4 view;
-uniform mat4 model;
+//per-frame data shared by every program, mirrors FrameData in main.cpp
+layout(std140, binding = 0) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	float fogDensity;
+};
 
 void main()
 {
-    vec4 tempPos = projection * view * vec4(vertexPosition, 1.0);
+    //the sky stays centered on the camera, only the rotation of the view is used
+    vec4 tempPos = projection * mat4(mat3(view)) * vec4(vertexPosition, 1.0);
     gl_Position = tempPos.xyww;
     textureCoordinates = vertexPosition;
 }
@@ -0,0 +1,17 @@
+#version 430 core
+
+in vec2 fTexCoords;
+in vec4 fColor;
+
+out vec4 color;
+
+//one channel, 1 where a glyph is lit
+uniform sampler2D font;
+
+void main()
+{
+	float coverage = texture(font, fTexCoords).r;
+	if (coverage < 0.5f)
+		discard;
+	color = fColor;
+}
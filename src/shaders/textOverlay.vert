@@ -0,0 +1,19 @@
+#version 430 core
+
+layout(location=0) in vec2 vPosition;
+layout(location=1) in vec2 vTexCoords;
+layout(location=2) in vec4 vColor;
+
+out vec2 fTexCoords;
+out vec4 fColor;
+
+//pixels, the origin is the top left corner
+uniform vec2 screenSize;
+
+void main()
+{
+	vec2 ndc = vPosition / screenSize * 2.0f - 1.0f;
+	gl_Position = vec4(ndc.x, -ndc.y, 0.0f, 1.0f);
+	fTexCoords = vTexCoords;
+	fColor = vColor;
+}